@@ -0,0 +1,57 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+class LensingAtlas;
+
+//Accuracy oracle for the lensing integrators
+//Every integrator mode is compared ray by ray against a double precision solution of the
+//exact Schwarzschild photon orbit equation, in vacuum (no disk or planets)
+
+//Where a vacuum ray ends up
+struct RayOutcome {
+    bool captured = false;
+    glm::dvec3 direction = glm::dvec3(0.0);//Direction the sky is sampled with when not captured
+    uint64_t steps = 0;
+};
+
+//One way of bending a camera ray, black hole at the origin
+struct IntegratorMode {
+    std::string name;
+    std::function<RayOutcome(const glm::vec3& pos, const glm::vec3& dir, float rs)> trace;
+};
+
+//Per-mode error against the reference
+struct AccuracyReport {
+    std::string name;
+    uint64_t rays = 0;
+    uint64_t falseCaptures = 0;//Mode captured a ray the reference lets escape
+    uint64_t falseEscapes = 0;//Mode let a captured ray escape
+    double meanError = 0.0;//Radians, over rays both agree escape
+    double p99Error = 0.0;
+    double maxError = 0.0;
+    uint64_t steps = 0;
+    double seconds = 0.0;
+
+    uint64_t misclassified() const { return falseCaptures + falseEscapes; }
+};
+
+namespace Accuracy {
+    //Integrate u'' = -u + 1.5 rs u^2 (u = 1/r, ' = d/dphi) in double precision from the ray
+    //start until the ray reaches infinity (u = 0) or crosses the horizon (u = 1/rs)
+    //The escape direction is the asymptote, not the direction at some finite radius
+    RayOutcome traceReference(const glm::dvec3& pos, const glm::dvec3& dir, double rs);
+
+    //Faster integrators to check against the reference, the one the renderer uses first
+    const std::vector<IntegratorMode>& modes();
+    //The deflection table modes again, resampled from a mapped lensing atlas
+    std::vector<IntegratorMode> atlasModes(const LensingAtlas& atlas);
+
+    //Compare a mode against precomputed reference outcomes for the same rays
+    //threadCount 0 = one worker per hardware thread
+    AccuracyReport measure(const IntegratorMode& mode, const std::vector<glm::vec3>& origins, const std::vector<glm::vec3>& dirs,
+        const std::vector<RayOutcome>& reference, float rs, unsigned threadCount = 0);
+}
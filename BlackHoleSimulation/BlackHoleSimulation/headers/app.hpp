@@ -10,7 +10,7 @@ struct GLFWwindow;
 
 class App {
 public:
-    App(int width, int height, const std::string& title);
+    App(int width, int height, const std::string& title, HdrFormat hdrFormat = HdrFormat::RGBA32F);
     ~App();
 
     void run();//Main loop
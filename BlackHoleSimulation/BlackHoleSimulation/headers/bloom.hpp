@@ -0,0 +1,53 @@
+#pragma once
+#include <glad/glad.h>
+#include "glHelpers.hpp"
+#include "hdrFormat.hpp"
+#include <cstddef>
+
+//Dual-filter bloom over a chain of half-float (or R11G11B10F) levels, level 0 at half the frame size and each one after half the
+//one before. geodesicShade.comp writes the bright part of the frame into level 0 as it shades it, from there it is
+//downsampled to the bottom of the chain (bloomDown.frag) and upsampled back up it (bloomUp.frag), each level
+//adding the wider blur below it. Every tap is a bilinear fetch between texels, so 5 taps down and 8 up cover 16
+//and 36 texels. The full resolution frame is never read. The chain holds a third as many texels as the frame, one
+//run reads and writes about 5/3 of the frame's texel count (frameTraffic), 5/6 of one full resolution read and write
+class Bloom {
+public:
+    static constexpr int MAX_LEVELS = 6;
+    static constexpr int MIN_SIZE = 8;//Smallest level, in pixels along the shorter side
+
+    Bloom() = default;
+    ~Bloom();
+    Bloom(const Bloom&) = delete;
+    Bloom& operator=(const Bloom&) = delete;
+
+    //Shaders and the chain for a width x height frame. Needs a current GL context
+    void init(int width, int height, HdrFormat format);
+
+    //Bytes the chain takes for a width x height frame at bytesPerPixel
+    static size_t chainBytes(int width, int height, int bytesPerPixel);
+    //Bytes one run of the chain reads and writes at bytesPerPixel, level 0's write by the shade pass and the
+    //composite's read of it included
+    static size_t frameTraffic(int width, int height, int bytesPerPixel);
+
+    //Blur level 0 through the chain, the result replaces it. quadVAO is the fullscreen quad. Changes the
+    //viewport and leaves blending on with the renderer's alpha blend function
+    void render(GLuint quadVAO);
+
+    //Level 0, written as an image by the shade pass and read by the composite
+    GLuint texture() const { return m_levels[0].texture; }
+    int levels() const { return m_levelCount; }
+
+private:
+    //Sizes of the chain's levels for a width x height frame, returns how many
+    static int levelSizes(int width, int height, int (&sizes)[MAX_LEVELS][2]);
+
+    struct Level {
+        GLuint texture = 0;
+        GLuint framebuffer = 0;
+        int width = 0, height = 0;
+    };
+
+    Level m_levels[MAX_LEVELS];
+    int m_levelCount = 0;
+    ShaderProgram m_downShader, m_upShader;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+//Bounding volume hierarchy over the orbiting bodies (planets, moons, debris), rebuilt every frame since they move
+//The march tests each step against it instead of every body, so a step costs O(log bodies). Same node layout and
+//traversal as the BvhNodes buffer in geodesic.comp
+namespace BodyBvh {
+    constexpr int LEAF_BODIES = 4;//Most bodies per leaf
+    constexpr int MAX_DEPTH = 32;//Traversal stack, BVH_STACK in geodesic.comp. Median splits stay far below it
+
+    //std430 layout of BvhNode in geodesic.comp. Nodes are depth first, an inner node's left child follows it
+    struct Node {
+        glm::vec3 boundsMin;
+        int32_t first;//Leaf: first entry in Tree::indices, inner node: right child
+        glm::vec3 boundsMax;
+        int32_t count;//Bodies in a leaf, 0 for an inner node
+    };
+
+    struct Tree {
+        std::vector<glm::vec4> spheres;//Bodies by index, xyz centre and w radius
+        std::vector<Node> nodes;//nodes[0] is the root, an empty leaf when there are no bodies
+        std::vector<int32_t> indices;//Body indices in leaf order
+    };
+
+    //Build the hierarchy over tree.spheres, splitting at the median centre along the widest axis
+    void build(Tree& tree);
+
+    //Nearest body the segment from a to b enters, t its fraction of the way there. -1 for none
+    //A segment starting inside a body enters it at t = 0
+    int firstHit(const Tree& tree, const glm::vec3& a, const glm::vec3& b, float& t);
+
+    //Distance from pos to the nearest body surface, limit when none is closer (negative inside a body)
+    float nearestSurface(const Tree& tree, const glm::vec3& pos, float limit);
+
+    //Sphere enclosing a node's bounds, and with them every body in it
+    inline glm::vec4 boundingSphere(const Node& node) {
+        return glm::vec4(0.5f * (node.boundsMin + node.boundsMax), 0.5f * glm::length(node.boundsMax - node.boundsMin));
+    }
+
+    //Whether inReach(centre, radius, node) holds for any body. It is asked about each node's bounding sphere
+    //first, with the node passed for its box, and must then answer true if any sphere inside could be in reach.
+    //Bodies come with node nullptr
+    template <class InReach>
+    bool any(const Tree& tree, InReach inReach) {
+        if (tree.spheres.empty()) return false;
+        int stack[MAX_DEPTH];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = tree.nodes[stack[--top]];
+            glm::vec4 bound = boundingSphere(node);
+            if (!inReach(glm::vec3(bound), bound.w, &node)) continue;
+            if (node.count == 0) {
+                stack[top++] = node.first;
+                stack[top++] = static_cast<int>(&node - tree.nodes.data()) + 1;
+                continue;
+            }
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                const glm::vec4& s = tree.spheres[tree.indices[i]];
+                if (inReach(glm::vec3(s), s.w, nullptr)) return true;
+            }
+        }
+        return false;
+    }
+}
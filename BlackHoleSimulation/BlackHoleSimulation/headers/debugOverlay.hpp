@@ -0,0 +1,59 @@
+#pragma once
+#include <glad/glad.h>
+#include "glHelpers.hpp"
+#include <string>
+#include <vector>
+#include <cstddef>
+
+//Debug text drawn with one indexed call out of one vertex buffer. Each line keeps the stb_easy_font quads of its
+//text, a line whose text is the same as last frame's is neither rebuilt nor uploaded again, so a frame with only
+//the FPS changed rebuilds that line and uploads from it to the end. The index buffer is the same quad pattern
+//for every frame and only grows
+class DebugOverlay {
+public:
+    static constexpr float LEFT = 10.0f, TOP = 30.0f;
+    static constexpr float LINE_HEIGHT = 20.0f;
+
+    //What the last draw() did
+    struct Stats {
+        int lines = 0;
+        int rebuiltLines = 0;
+        int quads = 0;
+        size_t uploadedBytes = 0;
+    };
+
+    DebugOverlay() = default;
+    ~DebugOverlay();
+    DebugOverlay(const DebugOverlay&) = delete;
+    DebugOverlay& operator=(const DebugOverlay&) = delete;
+
+    //Shaders and buffers. Needs a current GL context
+    void init();
+
+    //This frame's text, top line first. Only the lines that differ from last frame's get their quads rebuilt
+    void setLines(const std::vector<std::string>& lines);
+
+    //Upload what changed and draw every line over a width x height framebuffer
+    void draw(int width, int height);
+    const Stats& lastFrame() const { return m_lastFrame; }
+
+private:
+    struct Line {
+        std::string text;
+        std::vector<float> vertices;//x, y per corner, 4 corners per quad
+    };
+
+    void buildLine(int index, const std::string& text);
+
+    std::vector<Line> m_lines;
+    std::vector<float> m_vertices;//Every line's vertices back to back, what the vertex buffer holds
+    std::vector<char> m_glyphs;//stb_easy_font output for one line
+    int m_firstChanged = 0;//Lines before it are uploaded as they are, INT_MAX when nothing changed
+    int m_rebuilt = 0;
+
+    ShaderProgram m_shader;
+    GLuint m_vao = 0, m_vbo = 0, m_ebo = 0;
+    size_t m_vboBytes = 0;
+    int m_indexedQuads = 0;//Quads the index buffer covers
+    Stats m_lastFrame;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+class LensingAtlas;
+
+//Per-frame deflection table (shaders/deflectionLut.comp)
+//The hole is spherically symmetric, so a camera ray's orbit only depends on alpha, its angle from the
+//camera-to-hole direction. The table holds ENTRIES orbits for alpha in [0, maxAngle], each sampled as
+//u = 1/r and w = du/dphi on a uniform phi grid, and every pixel rotates its row into its own orbital plane
+namespace DeflectionLut {
+    constexpr int ENTRIES = 1024;//Rows, alpha = maxAngle * row / (ENTRIES - 1)
+    constexpr int SAMPLES = 512;//Samples per row
+    constexpr float MAX_PHI = 4.0f * 3.14159265f;//Orbits still going after two turns count as captured
+    constexpr float DPHI = MAX_PHI / SAMPLES;
+
+    //One row per alpha, same layout as LutRow in the shaders
+    struct Row {
+        float phiEnd;//Orbit angle of the asymptote (escapes) or of the horizon (captured)
+        float captured;//1 or 0
+        float rMin;//Closest approach to the hole
+        float _pad;
+    };
+
+    struct Table {
+        float maxAngle = 0.0f;
+        std::vector<Row> rows;//ENTRIES
+        std::vector<glm::vec2> samples;//ENTRIES * SAMPLES, (u, w) at phi = DPHI * i
+    };
+
+    //A ray rotated into the table: its orbital plane and the row(s) its alpha falls between
+    struct Lookup {
+        glm::vec3 e1, e2;//Plane of the orbit, e1 points from the hole to the camera
+        float alpha = 0.0f;
+        int row0 = 0, row1 = 0;
+        float blend = 0.0f;//Weight of row1
+        float phiEnd = 0.0f;
+        bool captured = false;
+        float rMin = 0.0f;
+        glm::vec3 asymptote() const;
+    };
+
+    //Widest angle between a camera ray and the camera-to-hole direction, from the frustum corners plus a
+    //small margin. pi once the hole can be behind the camera
+    float maxAngle(const glm::mat4& invView, const glm::mat4& invProj, const glm::vec3& camPos, const glm::vec3& bhPosition);
+
+    //Fill the table the way deflectionLut.comp does, binet picks the Binet orbit over the rk4Step force law
+    void build(float rs, float camRadius, float maxAngle, bool binet, Table& table);
+    //Same table resampled from the lensing atlas without integrating, false if the atlas doesn't cover camRadius
+    bool resample(const LensingAtlas& atlas, float rs, float camRadius, float maxAngle, bool binet, Table& table);
+
+    //One RK4 step of the orbit in phi, shared with the atlas builder
+    void orbitStep(float& u, float& w, float dphi, float rs, bool binet);
+
+    //Rotate a ray from pos (relative to the hole, at the table's camera radius) into the table, false past maxAngle
+    //Rows either side of the shadow edge don't blend, the nearer one wins
+    bool lookup(const Table& table, const glm::vec3& pos, const glm::vec3& dir, Lookup& result);
+    //(u, w) at orbit angle phi, u is a cubic Hermite between the samples since w is its slope
+    glm::vec2 sample(const Table& table, const Lookup& ray, float phi);
+}
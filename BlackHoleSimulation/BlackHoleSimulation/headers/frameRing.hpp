@@ -0,0 +1,49 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+
+//Per-frame uniform and storage blocks, suballocated from one persistently mapped buffer split into FRAMES regions
+//Each frame writes its region straight through the mapping and binds the blocks with glBindBufferRange, a fence
+//at the end of the frame guards the region until the GPU is done with it FRAMES frames later. No glBufferSubData
+//copies or buffer reallocations in the frame loop, and no implicit sync on a buffer the GPU still reads
+class FrameRing {
+public:
+    static constexpr int FRAMES = 3;
+
+    //What one frame pushed through the ring
+    struct Stats {
+        size_t bytes = 0;//Alignment padding included
+        int blocks = 0;
+        int fenceWaits = 0;//Times the region was still in use and the CPU had to wait for the GPU
+        int reallocations = 0;//The regions were too small and the buffer was replaced
+    };
+
+    FrameRing() = default;
+    ~FrameRing();
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    //Start writing the next region, waiting for its fence first. bytes bounds what the frame's blocks need, blocks
+    //how many there are at most (each is padded to the offset alignment). Needs a current GL context
+    void beginFrame(size_t bytes, int blocks);
+    //Copy a block into the region and bind it to target's index (GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER)
+    void bind(GLenum target, GLuint index, const void* data, size_t bytes);
+    //Fence the region, the GPU commands reading it have all been issued
+    void endFrame();
+
+    const Stats& lastFrame() const { return m_lastFrame; }
+    size_t regionBytes() const { return m_regionBytes; }
+
+private:
+    void allocate(size_t regionBytes);
+    void waitFence(int region);
+
+    GLuint m_buffer = 0;
+    unsigned char* m_mapped = nullptr;
+    size_t m_regionBytes = 0;
+    size_t m_alignment = 0;//Largest of the uniform and storage buffer offset alignments
+    GLsync m_fences[FRAMES] = {};
+    int m_region = 0;
+    size_t m_offset = 0;//In the current region
+    Stats m_frame, m_lastFrame;
+};
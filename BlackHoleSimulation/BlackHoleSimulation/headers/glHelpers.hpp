@@ -1,8 +1,85 @@
 #pragma once
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 #include <string>
+#include <vector>
+#include <unordered_map>
 
 namespace GLHelpers {
     GLuint loadShaderProgram(const std::string& vertPath, const std::string& fragPath);
-    GLuint loadComputeShader(const std::string& compPath);
+    //defines is inserted after the #version line, e.g. "#define X 1\n"
+    GLuint loadComputeShader(const std::string& compPath, const std::string& defines = "");
+}
+
+//Linked program with its active uniforms and uniform blocks reflected once, so the frame loop never looks a
+//location up by name. set() writes through glProgramUniform (no glUseProgram needed) and skips values the
+//program already holds, samplers with a layout binding included
+class ShaderProgram {
+public:
+    ShaderProgram() = default;
+    explicit ShaderProgram(GLuint program);//Takes ownership of a linked program
+    ~ShaderProgram();
+    ShaderProgram(ShaderProgram&& other) noexcept;
+    ShaderProgram& operator=(ShaderProgram&& other) noexcept;
+    ShaderProgram(const ShaderProgram&) = delete;
+    ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+    GLuint id() const { return m_program; }
+    void use() const;
+
+    //Uniforms the linker dropped are ignored, like location -1
+    void set(const std::string& name, int value);
+    void set(const std::string& name, GLuint value);
+    void set(const std::string& name, float value);
+    void set(const std::string& name, const glm::vec2& value);
+    void set(const std::string& name, const glm::ivec2& value);
+    void set(const std::string& name, const glm::vec3& value);
+    void set(const std::string& name, const glm::mat4& value);
+
+    //Point a uniform block at a binding, a no-op when it is already there (or the block isn't active)
+    void bindBlock(const std::string& name, GLuint binding);
+
+private:
+    struct Uniform {
+        GLint location;
+        GLenum type;
+        bool known;//value holds what the program has
+        float value[16];//Raw bits, as many as the type takes
+    };
+
+    //Writes the uniform unless it already holds the bytes at data
+    Uniform* changed(const std::string& name, const void* data, size_t bytes);
+
+    GLuint m_program = 0;
+    std::unordered_map<std::string, Uniform> m_uniforms;
+    std::unordered_map<std::string, std::pair<GLuint, GLuint>> m_blocks;//Index and binding
+};
+
+//Shadow of the binding state the renderer changes every frame: programs, VAOs, framebuffers, textures per unit,
+//image units and indexed buffers. A bind that matches the shadow is skipped. Anything bound behind its back must
+//go through it too (or invalidate() it), and deleted objects must be forgotten, their names get reused
+namespace GLState {
+    //GL calls of one frame, bindings and uniform writes
+    struct Stats {
+        int issued = 0;
+        int skipped = 0;//Redundant, never sent
+        int programSwitches = 0;
+    };
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+    void bindFramebuffer(GLuint framebuffer);//GL_FRAMEBUFFER
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    void bindImageTexture(GLuint unit, GLuint texture, GLint level, GLenum access, GLenum format);
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void deleteTexture(GLuint texture);
+    void deleteBuffer(GLuint buffer);
+
+    //Counts a uniform write made by ShaderProgram::set
+    void countUniform(bool issued);
+    //Forget everything, the next bind of each kind is sent
+    void invalidate();
+    void endFrame();
+    const Stats& lastFrame();
 }
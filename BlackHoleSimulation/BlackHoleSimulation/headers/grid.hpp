@@ -3,6 +3,7 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include "camera.hpp"
+#include "glHelpers.hpp"
 
 class Grid3D {
 public:
@@ -14,7 +15,7 @@ public:
 private:
     GLuint m_vao, m_vbo;
     size_t m_vertexCount;
-    GLuint m_shaderProgram;
+    ShaderProgram m_shaderProgram;
 
     void initShader();
 };
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+#include <glad/glad.h>
+
+//Pixel format of the HDR render targets, the shade pass's output (m_renderTex) and the bloom chain, picked at
+//startup with --hdr-format. Alpha is always 1, the narrower formats drop it or never had it
+enum class HdrFormat { RGBA32F, RGBA16F, R11G11B10F };
+
+namespace HdrFormats {
+    constexpr int COUNT = 3;
+
+    struct Info {
+        const char* name;//As given to --hdr-format
+        GLenum internalFormat;
+        const char* imageFormat;//GLSL image layout qualifier, for shaders that load and store it
+        int bytesPerPixel;
+    };
+
+    const Info& info(HdrFormat format);
+    //Case-sensitive, false leaves format as it was
+    bool parse(const char* name, HdrFormat& format);
+    //The bloom chain is blurred, it gets the HDR format but never wider than RGBA16F
+    HdrFormat bloomFormat(HdrFormat format);
+}
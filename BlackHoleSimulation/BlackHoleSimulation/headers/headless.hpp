@@ -0,0 +1,32 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+
+//Forward-declare GLFWwindow to avoid heavy includes in the header
+struct GLFWwindow;
+
+//Core OpenGL 4.5 context with no window to present to, current on the calling thread. On Linux a surfaceless EGL
+//context, so it runs on nodes with no display server (Mesa's llvmpipe when there is no GPU either). Elsewhere
+//an invisible GLFW window. Frames are rendered into framebuffer() and read back, nothing is swapped, so no frame
+//waits for vsync
+class HeadlessContext {
+public:
+    HeadlessContext(int width, int height);
+    ~HeadlessContext();
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    //RGBA8 colour and a depth buffer at the context's size, what the renderer's composite targets in place of the window
+    GLuint framebuffer() const { return m_framebuffer; }
+    //The framebuffer as RGBA floats, bottom row first
+    void readPixels(std::vector<float>& rgba) const;
+    const char* backend() const;
+
+private:
+    int m_width, m_height;
+    void* m_display = nullptr;//EGLDisplay
+    void* m_context = nullptr;//EGLContext
+    GLFWwindow* m_window = nullptr;
+    GLuint m_framebuffer = 0;
+    GLuint m_renderbuffers[2] = { 0, 0 };//Colour, depth
+};
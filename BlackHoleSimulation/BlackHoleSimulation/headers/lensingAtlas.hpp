@@ -0,0 +1,78 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+//Precomputed lensing atlas (--build-atlas), memory-mapped at startup
+//Every photon orbit around the hole belongs to one family labelled by its conserved invariant c
+//(impact parameter b for the Binet orbit, K = r sin(alpha) e^(rs/r) for the rk4Step force law),
+//and a camera at any radius only starts part way along one of them. The atlas stores each orbit
+//once, from the incoming asymptote, in units of rs, so the (camera radius, alpha) table of
+//deflectionLut.comp is resampled from it instead of integrated. Nothing in it depends on the
+//scene, a single file serves every hole mass and camera radius
+class LensingAtlas {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr int ORBITS = 2048;//Per force law
+    static constexpr int PLUNGE_ORBITS = 768;//Rows below the critical invariant, the rest scatter
+    static constexpr int SAMPLES = 768;//(u, w) per orbit at psi = DPSI * i from the incoming asymptote
+    static constexpr float DPSI = 3.14159265f / 128.0f;//Same spacing as DeflectionLut::DPHI
+    static constexpr float PSI_MAX = DPSI * SAMPLES;//Three turns, orbits still going count as captured
+    static constexpr float C_MAX = 5000.0f;//Widest orbit, rays past it are treated as the widest
+    static constexpr float MIN_CAMERA_RADIUS = 2.0f;//In rs, closer cameras integrate their table
+
+    //One orbit, same layout as AtlasOrbit in deflectionLut.comp
+    struct Orbit {
+        float c;//Invariant in units of rs
+        float psiEnd;//Orbit angle of the outgoing asymptote (escapes) or the horizon (captured)
+        float psiPeri;//Orbit angle of the closest approach, u rises monotonically before it
+        float uPeri;//rs / closest approach
+        float captured;//1 or 0
+        float _pad[3];
+    };
+
+    LensingAtlas() = default;
+    ~LensingAtlas();
+    LensingAtlas(const LensingAtlas&) = delete;
+    LensingAtlas& operator=(const LensingAtlas&) = delete;
+
+    //Map an atlas written by build(), false if it is missing, truncated or from another version
+    bool map(const std::string& path);
+    void unmap();
+    bool mapped() const { return m_data != nullptr; }
+
+    //Both force laws back to back, rk4Step first, straight out of the mapping for upload
+    const Orbit* orbits() const;//2 * ORBITS
+    const glm::vec2* samples() const;//2 * ORBITS * SAMPLES
+    const Orbit* orbits(bool binet) const { return orbits() + (binet ? ORBITS : 0); }
+    const glm::vec2* samples(bool binet) const { return samples() + (binet ? static_cast<size_t>(ORBITS) * SAMPLES : 0); }
+    static size_t orbitBytes() { return 2 * ORBITS * sizeof(Orbit); }
+    static size_t sampleBytes() { return static_cast<size_t>(2) * ORBITS * SAMPLES * sizeof(glm::vec2); }
+
+    //Integrate both orbit families and write them to path
+    static bool build(const std::string& path);
+
+    //Row spacing, logarithmic in the distance from the critical invariant either side of it
+    static float criticalInvariant(bool binet);
+    static float orbitInvariant(int row, bool binet);
+    static float orbitRow(float c, bool binet);//Fractional row, clamped to the table
+
+    //rs / closest approach of the orbit with invariant c, only for c above the critical invariant
+    static float periapsis(float c, bool binet);
+
+    //(u, w) of one orbit's samples at psi, cubic Hermite in u like DeflectionLut::sample
+    static glm::vec2 sample(const glm::vec2* orbit, float psi);
+    //Orbit angle at which the inbound leg first reaches u, the closest approach if it never does
+    static float inboundAngle(const Orbit& orbit, const glm::vec2* samples, float u);
+
+private:
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+};
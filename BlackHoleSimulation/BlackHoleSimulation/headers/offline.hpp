@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include "physics.hpp"
+#include "hdrFormat.hpp"
+
+//Command line entry points that run without a window (batch renders, benchmarks)
+namespace Offline {
+    struct Options {
+        int width = 1280;
+        int height = 720;
+        unsigned threads = 0;//0 = all hardware threads
+        std::string output = "frame.ppm";
+        bool packets = true;//false runs the one-ray-at-a-time tracer
+        IntegratorType integrator = IntegratorType::RK4;
+        float tolerance = 1e-5f;
+        bool analyticEscape = true;
+        bool classifyRays = true;
+        bool deflectionLut = true;
+        bool variableRate = false;
+        bool wavefront = true;//Refill packet lanes between step chunks (CpuTracer::setWavefront)
+        int belt = 0;//Debris belt bodies added to the two planets (Physics::debrisBelt)
+        std::string atlas = "lensingAtlas.bin";//Empty integrates the deflection table every frame
+        HdrFormat hdrFormat = HdrFormat::RGBA32F;//Render targets of the GPU renderer
+        int frames = 1;//GPU frames rendered headless, the last one is written
+    };
+
+    //Parse --size WxH, --threads N, --out path, --no-packets, --integrator rk4|dopri5|binet,
+    //--tolerance x, --no-analytic-escape, --no-classify, --no-lut, --atlas path, --no-atlas,
+    //--variable-rate, --no-wavefront, --belt N, --hdr-format rgba32f|rgba16f|r11g11b10f and --frames N, unknown flags are ignored
+    Options parseOptions(int argc, char** argv);
+
+    //Integrate the lensing atlas and write it to options.atlas
+    int buildAtlas(const Options& options);
+
+    //Render one frame of the default scene with the CPU tracer and write it as a PPM
+    int renderCpu(const Options& options);
+
+    //Render options.frames frames with the GPU renderer in an offscreen context (HeadlessContext), print each one's
+    //time and write the last as a PPM. Nothing is presented, so no frame waits for vsync
+    int renderHeadless(const Options& options);
+
+    //Target memory and per-frame traffic of every --hdr-format at --size, nothing is rendered
+    int hdrReport(const Options& options);
+
+    //Render the default scene at 1, 2, 4 ... N threads and print rays/s, steps/s and scaling
+    int benchmarkCpu(const Options& options);
+
+    //Single-core steps/s of the scalar rk4Step port against each supported ray packet ISA
+    int benchmarkPacket(const Options& options);
+
+    //Deflection error and capture/escape misclassification of every integrator mode against
+    //the double precision reference, one ray per tile of the frame
+    int accuracyReport(const Options& options);
+}
@@ -0,0 +1,296 @@
+#pragma once
+#include "rayPacket.hpp"
+
+//Shared body of the RK4 packet kernel
+//Each ISA translation unit defines Vf (float lanes) and Vm (lane mask) plus the helper
+//functions below, then instantiates advanceLanes<Vf, Vm>:
+//  Vf::WIDTH, Vf::load, Vf::store, Vf::set1
+//  + - * / on Vf, vsqrt, vabs, select(mask, a, b)
+//  < > on Vf returning Vm, & | andNot on Vm, maskBits(Vm), maskFromBits(unsigned)
+//Compared to rk4Step in geodesic.comp the kernel folds length + normalize into one
+//reciprocal square root per acceleration evaluation, the math is otherwise identical
+//Only call the ISA helpers and code in this header, never an inline function from glm, the standard library
+//or another header: the linker may keep the AVX copy of it for scalar callers too
+
+namespace PacketKernel {
+
+    constexpr int BVH_STACK = 32;//BodyBvh::MAX_DEPTH, checked in rayPacket.cpp
+
+    static inline int popcount(unsigned v) {
+        v = v - ((v >> 1) & 0x55555555u);
+        v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+        return static_cast<int>((((v + (v >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24);
+    }
+
+    //a = -rs / r^2 * normalize(p) = -rs * p / r^3
+    template <class Vf>
+    inline void accel(Vf x, Vf y, Vf z, Vf rs, Vf& ax, Vf& ay, Vf& az) {
+        Vf r2 = x * x + y * y + z * z;
+        Vf invR = Vf::set1(1.0f) / vsqrt(r2);
+        Vf k = rs * invR * invR * invR;
+        ax = Vf::set1(0.0f) - k * x;
+        ay = Vf::set1(0.0f) - k * y;
+        az = Vf::set1(0.0f) - k * z;
+    }
+
+    template <class Vf>
+    inline void normalize(Vf& x, Vf& y, Vf& z) {
+        Vf inv = Vf::set1(1.0f) / vsqrt(x * x + y * y + z * z);
+        x = x * inv;
+        y = y * inv;
+        z = z * inv;
+    }
+
+    //One RK4 step for all lanes (same stages as rk4Step)
+    template <class Vf>
+    inline void rk4(Vf& px, Vf& py, Vf& pz, Vf& dx, Vf& dy, Vf& dz, Vf h, Vf rs) {
+        Vf half = h * Vf::set1(0.5f);
+        Vf k1vx, k1vy, k1vz;
+        accel(px, py, pz, rs, k1vx, k1vy, k1vz);
+
+        Vf k2vx, k2vy, k2vz;
+        accel(px + half * dx, py + half * dy, pz + half * dz, rs, k2vx, k2vy, k2vz);
+        Vf k2x = dx + half * k1vx, k2y = dy + half * k1vy, k2z = dz + half * k1vz;
+        normalize(k2x, k2y, k2z);
+
+        Vf k3vx, k3vy, k3vz;
+        accel(px + half * k2x, py + half * k2y, pz + half * k2z, rs, k3vx, k3vy, k3vz);
+        Vf k3x = dx + half * k2vx, k3y = dy + half * k2vy, k3z = dz + half * k2vz;
+        normalize(k3x, k3y, k3z);
+
+        Vf k4vx, k4vy, k4vz;
+        accel(px + h * k3x, py + h * k3y, pz + h * k3z, rs, k4vx, k4vy, k4vz);
+        Vf k4x = dx + h * k3vx, k4y = dy + h * k3vy, k4z = dz + h * k3vz;
+        normalize(k4x, k4y, k4z);
+
+        Vf sixth = h * Vf::set1(1.0f / 6.0f);
+        Vf two = Vf::set1(2.0f);
+        Vf ndx = dx + sixth * (k1vx + two * (k2vx + k3vx) + k4vx);
+        Vf ndy = dy + sixth * (k1vy + two * (k2vy + k3vy) + k4vy);
+        Vf ndz = dz + sixth * (k1vz + two * (k2vz + k3vz) + k4vz);
+        normalize(ndx, ndy, ndz);
+
+        px = px + sixth * (dx + two * (k2x + k3x) + k4x);
+        py = py + sixth * (dy + two * (k2y + k3y) + k4y);
+        pz = pz + sixth * (dz + two * (k2z + k3z) + k4z);
+        dx = ndx;
+        dy = ndy;
+        dz = ndz;
+    }
+
+    //Walk the planet hierarchy for the lanes in mask: nodeTest(node, lanes) returns the lanes the node's bodies can
+    //matter to, bodyTest(body, lanes) is called for each body of a leaf some lane reached
+    template <class Vm, class NodeTest, class BodyTest>
+    inline void traversePlanets(const PacketPlanets& planets, Vm mask, NodeTest nodeTest, BodyTest bodyTest) {
+        struct Entry {
+            int node;
+            unsigned lanes;
+        };
+        if (planets.bodies == 0) return;
+        Entry stack[BVH_STACK];
+        int top = 0;
+        stack[top++] = { 0, maskBits(mask) };
+        while (top > 0) {
+            Entry entry = stack[--top];
+            Vm lanes = nodeTest(entry.node, maskFromBits(entry.lanes));
+            unsigned bits = maskBits(lanes);
+            if (!bits) continue;
+            int first = planets.nodeFirst[entry.node], count = planets.nodeCount[entry.node];
+            if (count == 0) {
+                stack[top++] = { first, bits };
+                stack[top++] = { entry.node + 1, bits };
+                continue;
+            }
+            for (int i = first; i < first + count; ++i) {
+                bodyTest(planets.indices[i], lanes);
+            }
+        }
+    }
+
+    //Advance lanes [offset, offset + Vf::WIDTH) of the packet
+    template <class Vf, class Vm>
+    uint64_t advanceLanes(RayPacket& p, int offset, const PacketParams& params) {
+        const int W = Vf::WIDTH;
+
+        unsigned activeBits = 0, skipBits = 0;
+        for (int i = 0; i < W; ++i) {
+            if (p.status[offset + i] == LANE_ACTIVE) activeBits |= 1u << i;
+            if (p.flags[offset + i] & LANE_SKIP_DISK) skipBits |= 1u << i;
+        }
+        if (!activeBits) return 0;
+
+        Vf px = Vf::load(p.px + offset), py = Vf::load(p.py + offset), pz = Vf::load(p.pz + offset);
+        Vf dx = Vf::load(p.dx + offset), dy = Vf::load(p.dy + offset), dz = Vf::load(p.dz + offset);
+
+        const Vf rs = Vf::set1(params.rs);
+        const Vf h = Vf::set1(params.stepSize);
+        const Vf escape2 = Vf::set1(params.escapeRadius * params.escapeRadius);
+        const Vf band = Vf::set1(params.diskBand);
+        const Vf inner2 = Vf::set1(params.diskInnerRadius * params.diskInnerRadius);
+        const Vf outer2 = Vf::set1(params.diskOuterRadius * params.diskOuterRadius);
+        const Vf photonR = Vf::set1(params.rs * 1.5f);
+        const Vf photonT = Vf::set1(params.rs * 0.1f);
+
+        Vm active = maskFromBits(activeBits);
+        Vm skipDisk = maskFromBits(skipBits);
+        Vm nearPhoton = maskFromBits(0);
+
+        //Steps are counted in float lanes, exact well past any maxSteps
+        float stepsIn[PACKET_LANES];
+        for (int i = 0; i < W; ++i) stepsIn[i] = static_cast<float>(p.steps[offset + i]);
+        Vf steps = Vf::load(stepsIn);
+        const Vf maxSteps = Vf::set1(static_cast<float>(params.maxSteps));
+
+        uint64_t total = 0;
+        while (maskBits(active)) {
+            Vf r2 = px * px + py * py + pz * pz;
+            Vf r = vsqrt(r2);
+
+            Vm captured = active & (r < rs);
+            nearPhoton = nearPhoton | (active & (vabs(r - photonR) < photonT));
+
+            Vf diskR2 = px * px + pz * pz;
+            Vm disk = andNot(captured | skipDisk, active) & (vabs(py) < band) & (diskR2 > inner2) & (diskR2 < outer2);
+
+            Vm escaped = active & (r2 > escape2);
+
+            //Analytic escape, same test as canEscape() in physics.cpp
+            unsigned analyticBits = 0;
+            if (params.analyticEscape) {
+                const Vf zero = Vf::set1(0.0f), one = Vf::set1(1.0f);
+                Vf pd = px * dx + py * dy + pz * dz;
+                Vm candidate = andNot(captured | disk, active) & (zero < pd) & (r2 > outer2);
+                if (maskBits(candidate) && params.planets.bodies > 0) {
+                    //Largest bend left, a planet is only reachable within this of the straight line
+                    Vf mu = pd / r;
+                    Vf delta = rs / r * vsqrt((one - mu) / (one + mu));
+                    Vm reached = maskFromBits(0);
+                    auto inReach = [&](const float* s, Vm lanes, bool enclosing) {
+                        Vf ox = px - Vf::set1(s[0]), oy = py - Vf::set1(s[1]), oz = pz - Vf::set1(s[2]);
+                        Vf along = ox * dx + oy * dy + oz * dz;
+                        Vf miss2 = ox * ox + oy * oy + oz * oz - along * along;
+                        Vf radius = Vf::set1(s[3]);
+                        //A node's bounding sphere: any sphere inside it is ahead of -radius and within
+                        //radius + delta (ahead + radius) of the line
+                        Vf reach = enclosing ? radius + delta * (radius - along) : radius - delta * along;
+                        Vf behind = enclosing ? radius : zero;
+                        return andNot(reached, lanes) & (along < behind) & (miss2 < reach * reach);
+                    };
+                    traversePlanets(params.planets, candidate,
+                        [&](int node, Vm lanes) { return inReach(params.planets.nodeSpheres + 4 * node, lanes, true); },
+                        [&](int body, Vm lanes) { reached = reached | inReach(params.planets.spheres + 4 * body, lanes, false); });
+                    candidate = andNot(reached, candidate);
+                }
+                analyticBits = maskBits(candidate);
+                escaped = escaped | candidate;
+            }
+
+            //Priority follows the order of the checks in the shader
+            unsigned capturedBits = maskBits(captured);
+            unsigned diskBits = maskBits(disk) & ~capturedBits;
+            unsigned escapedBits = maskBits(escaped) & ~(capturedBits | diskBits);
+            unsigned stopBits = capturedBits | diskBits | escapedBits;
+            if (stopBits) {
+                for (int i = 0; i < W; ++i) {
+                    unsigned bit = 1u << i;
+                    if (!(stopBits & bit)) continue;
+                    p.status[offset + i] = (capturedBits & bit) ? LANE_CAPTURED :
+                                           (diskBits & bit) ? LANE_DISK : LANE_ESCAPED;
+                    if (analyticBits & bit) p.flags[offset + i] |= LANE_ANALYTIC_ESCAPE;
+                }
+                active = andNot(maskFromBits(stopBits), active);
+            }
+
+            //Step the survivors, stopped lanes keep their position for the tracer
+            Vf nx = px, ny = py, nz = pz, ndx = dx, ndy = dy, ndz = dz;
+            rk4(nx, ny, nz, ndx, ndy, ndz, h, rs);
+
+            //Planets the step passed into, the nearest entry along it wins (BodyBvh::firstHit)
+            unsigned planetBits = 0;
+            if (params.planets.bodies > 0 && maskBits(active)) {
+                const Vf zero = Vf::set1(0.0f), one = Vf::set1(1.0f);
+                Vf sx = nx - px, sy = ny - py, sz = nz - pz;
+                Vf lox = select(px < nx, px, nx), loy = select(py < ny, py, ny), loz = select(pz < nz, pz, nz);
+                Vf hix = select(px < nx, nx, px), hiy = select(py < ny, ny, py), hiz = select(pz < nz, nz, pz);
+                Vf dd = sx * sx + sy * sy + sz * sz;
+                Vf nearest = one;
+                Vm entered = maskFromBits(0);
+                traversePlanets(params.planets, active,
+                    [&](int node, Vm lanes) {
+                        const float* b = params.planets.nodeBounds + 6 * node;
+                        Vm apart = (hix < Vf::set1(b[0])) | (hiy < Vf::set1(b[1])) | (hiz < Vf::set1(b[2]))
+                            | (lox > Vf::set1(b[3])) | (loy > Vf::set1(b[4])) | (loz > Vf::set1(b[5]));
+                        return andNot(apart, lanes);
+                    },
+                    [&](int body, Vm lanes) {
+                        const float* s = params.planets.spheres + 4 * body;
+                        Vf ox = px - Vf::set1(s[0]), oy = py - Vf::set1(s[1]), oz = pz - Vf::set1(s[2]);
+                        Vf c = ox * ox + oy * oy + oz * oz - Vf::set1(s[3] * s[3]);
+                        Vf b = ox * sx + oy * sy + oz * sz;
+                        Vf disc = b * b - dd * c;
+                        Vm inside = c < zero;
+                        Vf t = select(inside, zero, (zero - b - vsqrt(select(disc < zero, zero, disc))) / dd);
+                        Vm enters = lanes & (inside | andNot((disc < zero) | (one < t), b < zero)) & (t < nearest);
+                        unsigned bits = maskBits(enters);
+                        if (!bits) return;
+                        for (int i = 0; i < W; ++i) {
+                            if (bits & (1u << i)) p.planet[offset + i] = body;
+                        }
+                        nearest = select(enters, t, nearest);
+                        entered = entered | enters;
+                    });
+                planetBits = maskBits(entered);
+                if (planetBits) {
+                    //Stop on the surface where the step went in
+                    nx = select(entered, px + nearest * sx, nx);
+                    ny = select(entered, py + nearest * sy, ny);
+                    nz = select(entered, pz + nearest * sz, nz);
+                }
+            }
+            px = select(active, nx, px);
+            py = select(active, ny, py);
+            pz = select(active, nz, pz);
+            dx = select(active, ndx, dx);
+            dy = select(active, ndy, dy);
+            dz = select(active, ndz, dz);
+            steps = select(active, steps + Vf::set1(1.0f), steps);
+            total += popcount(maskBits(active));
+            p.issuedSteps += W;
+            skipDisk = andNot(active, skipDisk);
+
+            if (planetBits) {
+                for (int i = 0; i < W; ++i) {
+                    if (planetBits & (1u << i)) p.status[offset + i] = LANE_PLANET;
+                }
+                active = andNot(maskFromBits(planetBits), active);
+            }
+
+            Vm limit = active & (maxSteps < steps + Vf::set1(0.5f));
+            unsigned limitBits = maskBits(limit);
+            if (limitBits) {
+                for (int i = 0; i < W; ++i) {
+                    if (limitBits & (1u << i)) p.status[offset + i] = LANE_STEP_LIMIT;
+                }
+                active = andNot(limit, active);
+            }
+        }
+
+        px.store(p.px + offset);
+        py.store(p.py + offset);
+        pz.store(p.pz + offset);
+        dx.store(p.dx + offset);
+        dy.store(p.dy + offset);
+        dz.store(p.dz + offset);
+
+        float stepsOut[PACKET_LANES];
+        steps.store(stepsOut);
+        unsigned nearBits = maskBits(nearPhoton);
+        unsigned stillSkip = maskBits(skipDisk);
+        for (int i = 0; i < W; ++i) {
+            p.steps[offset + i] = static_cast<int32_t>(stepsOut[i]);
+            if (nearBits & (1u << i)) p.flags[offset + i] |= LANE_NEAR_PHOTON_SPHERE;
+            if (!(stillSkip & (1u << i))) p.flags[offset + i] &= ~LANE_SKIP_DISK;
+        }
+        return total;
+    }
+}
@@ -1 +1,212 @@
 #pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "tileScheduler.hpp"
+#include "rayPacket.hpp"
+#include "bodyBvh.hpp"
+
+class LensingAtlas;
+
+//Ray integrators, the values match uIntegrator in geodesic.comp
+enum class IntegratorType : int {
+    RK4 = 0,//Fixed 0.1 unit steps
+    DormandPrince = 1,//Adaptive Dormand-Prince 5(4), step size follows the local error estimate
+    Binet = 2//u'' + u = 1.5 rs u^2 in the orbital plane, same 0.1 unit steps as RK4
+};
+
+//Photon orbit in its plane: u = 1/r and w = du/dphi, phi measured from e1 towards e2
+struct OrbitState {
+    glm::vec3 e1, e2;
+    float u, w, phi;
+};
+
+//Small body of the debris belt, circling the hole at orbitRadius in a plane tilted about the x axis
+struct BeltBody {
+    float orbitRadius;
+    float orbitPhase;//Angle at time 0
+    float orbitInclination;
+    float radius;
+    glm::vec3 color;
+
+    glm::vec3 position(float angle) const;//Same orbit as the Renderer's planets
+};
+
+//What the impact parameter alone says about a ray
+enum class RayFate : int {
+    Ambiguous = 0,//Near the shadow edge (or outbound), needs the integrator
+    Captured = 1,
+    Escapes = 2
+};
+
+//Orbital plane of a classified ray, phi measured from the start position towards e2
+struct ImpactSweep {
+    glm::vec3 e1 = glm::vec3(0.0f), e2 = glm::vec3(0.0f);
+    float periapsis = 0.0f;//Escapes only
+    float phiEscape = 0.0f;//Escapes only, the asymptote is cos(phiEscape) e1 + sin(phiEscape) e2
+    //While the ray is between the inner and outer radius phi stays within [phiEnter, phiLeave]
+    //(phiLeave < phiEnter when it never gets there)
+    float phiEnter = 0.0f;
+    float phiLeave = 0.0f;
+};
+
+//Physical constants and helpers shared by the GPU and CPU paths
+namespace Physics {
+    constexpr double G = 6.67430e-11;//Gravitational constant (m^3 kg^-1 s^-2)
+    constexpr double c = 2.99792458e8;//Speed of light in vacuum (m/s)
+    constexpr double solarMass = 1.98847e30;//Mass of the sun (kg)
+
+    //Schwarzschild radius r_s = 2GM/c^2 (meters)
+    inline double schwarzschildRadius(double massKg) { return 2.0 * G * massKg / (c * c); }
+
+    //CPU ports of the geodesic.comp integration functions
+    glm::vec3 schwarzschildAccel(const glm::vec3& pos, float rs);
+    void rk4Step(glm::vec3& pos, glm::vec3& dir, float stepSize, float rs);
+
+    //Error controlled Dormand-Prince 5(4) step, same as dopri5Step in geodesic.comp
+    //accel holds schwarzschildAccel(pos) and is updated for the new position (first same as last)
+    //stepSize is clamped to maxStep and shrunk until the error estimate is within tolerance,
+    //on return it holds the size to try next. Returns the number of attempts
+    int dopri5Step(glm::vec3& pos, glm::vec3& dir, glm::vec3& accel, float& stepSize, float maxStep, float rs, float tolerance);
+    //Orbital plane of a ray, false for (nearly) radial rays which have no plane to speak of
+    bool orbitFromRay(const glm::vec3& pos, const glm::vec3& dir, OrbitState& orbit);
+    //RK4 step of the Binet equation over dphi
+    void binetStep(OrbitState& orbit, float dphi, float rs);
+    //Angle step that moves about stepSize along the orbit
+    float binetAngleStep(const OrbitState& orbit, float stepSize);
+    //3D position and direction on the orbit
+    void orbitToRay(const OrbitState& orbit, glm::vec3& pos, glm::vec3& dir);
+
+    //Escape: once a ray is outbound and past every feature the rest of its bend is computed directly
+    //First order estimate of the remaining deflection under the rk4Step force law,
+    //delta = rs / r * sqrt((1 - mu) / (1 + mu)), mu = cosine between pos and dir
+    float escapeDeflection(const glm::vec3& pos, const glm::vec3& dir, float rs);
+    //Asymptotic direction of an outbound ray under the rk4Step force law
+    glm::vec3 escapeDirection(const glm::vec3& pos, const glm::vec3& dir, float rs);
+    //Asymptotic direction of an outbound Binet orbit (u'' + u = 1.5 rs u^2)
+    glm::vec3 binetEscapeDirection(const OrbitState& orbit, float rs);
+
+    //Impact parameter classification of an inbound ray before any marching, binet picks the Binet orbit
+    //over the rk4Step force law. Outbound and radial rays, and rays within IMPACT_BAND of the critical
+    //impact parameter, are Ambiguous. innerRadius / outerRadius is the shell sweep bounds are wanted for
+    RayFate classifyImpact(const glm::vec3& pos, const glm::vec3& dir, float rs, bool binet, float innerRadius, float outerRadius, ImpactSweep& sweep);
+
+    glm::vec3 generateRay(const glm::mat4& invView, const glm::mat4& invProj, glm::vec2 pixel, glm::vec2 resolution);
+
+    //count debris bodies between 12 and 18 rs, the same belt for the Renderer and the offline scene
+    std::vector<BeltBody> debrisBelt(int count, float rs);
+}
+
+//RGBA8 image kept in system memory so the CPU tracer can sample it without a GL context
+//Rows are stored in upload order, so row 0 matches t = 0 like the GL textures
+struct CpuTexture {
+    int width = 0, height = 0;
+    std::vector<unsigned char> pixels;
+    bool repeat = true;//GL_REPEAT when true, GL_CLAMP_TO_EDGE otherwise
+
+    bool load(const std::string& path);
+    glm::vec4 sample(glm::vec2 uv) const;//Bilinear, like GL_LINEAR
+};
+
+//Six CpuTexture faces in GL order: +X, -X, +Y, -Y, +Z, -Z
+struct CpuCubemap {
+    CpuTexture faces[6];
+
+    bool load(const std::vector<std::string>& paths);
+    glm::vec3 sample(const glm::vec3& dir) const;
+};
+
+//Textures used by the tracer, loaded from the same files as the Renderer
+struct SceneAssets {
+    CpuTexture smoke;
+    CpuCubemap skybox;
+    std::vector<CpuTexture> planetTextures;
+};
+
+//Planet as seen by the tracer (mirrors PlanetData in geodesic.comp)
+struct TracePlanet {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    int texture;//Index into SceneAssets::planetTextures
+};
+
+//Everything one frame of the geodesic.comp pipeline reads from its UBOs/SSBOs
+struct TraceScene {
+    glm::mat4 invView;
+    glm::mat4 invProj;
+    glm::vec3 camPos;
+
+    glm::vec3 bhPosition = glm::vec3(0.0f);
+    float bhRadius = 0.0f;
+
+    float diskInnerRadius = 0.0f;
+    float diskOuterRadius = 0.0f;
+    glm::vec3 diskColor = glm::vec3(0.0f);
+
+    float time = 0.0f;
+    std::vector<TracePlanet> planets;
+    BodyBvh::Tree planetTree;//Over planets, CpuTracer::render rebuilds it every frame
+
+    IntegratorType integrator = IntegratorType::RK4;
+    bool analyticEscape = true;//Stop outbound rays past the disk and planets, bend the rest analytically
+    bool classifyRays = true;//Resolve captured and wide rays from their impact parameter, march only the rest
+    bool deflectionLut = true;//Read rays off a per-frame table of orbits by angle from the hole, march only the rest
+    const LensingAtlas* atlas = nullptr;//Resample the table from this instead of integrating it, when it covers the camera
+    float tolerance = 1e-5f;//Per step error bound of the adaptive integrator
+    bool variableRate = false;//Trace a coarse grid, then full rate only in the cells whose corners disagree
+    const SceneAssets* assets = nullptr;
+};
+
+//Throughput counters for one render call
+struct TraceStats {
+    uint64_t rays = 0;//Traced, variable rate fills in the rest
+    uint64_t filledPixels = 0;//Interpolated by variable rate instead of traced
+    uint64_t steps = 0;
+    uint64_t resolvedRays = 0;//Settled by the impact parameter pre-pass without marching
+    uint64_t tableRays = 0;//Read off the deflection table
+    uint64_t packetSteps = 0;//Taken by the ray packet kernel, part of steps
+    uint64_t packetIssuedSteps = 0;//Lane steps the packet kernel paid for, including idle lanes
+    double seconds = 0.0;
+    unsigned threads = 0;
+
+    double raysPerSecond() const { return seconds > 0.0 ? rays / seconds : 0.0; }
+    double stepsPerSecond() const { return seconds > 0.0 ? steps / seconds : 0.0; }
+    double packetUtilisation() const { return packetIssuedSteps ? static_cast<double>(packetSteps) / packetIssuedSteps : 0.0; }
+};
+
+//Multithreaded CPU implementation of geodesic.comp
+//Traces the same rays and shading as the compute shader, 8x8-pixel tiles at a time
+class CpuTracer {
+public:
+    explicit CpuTracer(unsigned threadCount = 0);//0 = one worker per hardware thread
+
+    //Render a width x height frame into a caller-owned RGBA float buffer (width * height * 4 floats)
+    //Rows are bottom-up, matching imageStore into m_renderTex
+    TraceStats render(const TraceScene& scene, int width, int height, float* rgba);
+
+    unsigned threadCount() const { return m_scheduler.threadCount(); }
+
+    //Packets are on by default with the widest ISA the machine supports
+    //Turning them off runs the one-ray-at-a-time port of the shader loop
+    //The packet kernel only takes fixed RK4 steps, adaptive scenes always trace one ray at a time
+    void setUsePackets(bool usePackets) { m_usePackets = usePackets; }
+    void setPacketIsa(PacketIsa isa) { m_isa = isa; }
+    PacketIsa packetIsa() const { return m_isa; }
+
+    //Wavefront packets: the kernel runs WAVEFRONT_CHUNK steps at a time and between chunks the lanes whose rays
+    //stopped take the next rays of the worker's queue, instead of idling until the packet's slowest ray is done
+    void setWavefront(bool wavefront) { m_wavefront = wavefront; }
+
+    static constexpr int TILE_SIZE = 8;//Same footprint as the compute shader workgroup
+    static constexpr int VARIABLE_RATE_STEP = 4;//Coarse grid spacing, same as refine.comp
+    static constexpr int WAVEFRONT_CHUNK = 200;//Same as the Renderer's, the step limit is a multiple of it
+    static_assert(TILE_SIZE % VARIABLE_RATE_STEP == 0, "Variable rate cells must not straddle tiles");
+
+private:
+    TileScheduler m_scheduler;
+    bool m_usePackets;
+    PacketIsa m_isa;
+    bool m_wavefront = true;
+};
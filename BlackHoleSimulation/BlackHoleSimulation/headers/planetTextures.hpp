@@ -0,0 +1,44 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include <map>
+
+//Planet surfaces packed into the layers of one GL_TEXTURE_2D_ARRAY (uPlanetTextures in geodesicShade.comp),
+//so any number of textured bodies shade with a single bind. Every source image is resampled to the layer size
+//whatever its own, and its mip chain is filtered on the CPU, so uploading a new layer never touches the others
+class PlanetTextureArray {
+public:
+    static constexpr int LAYER_WIDTH = 1024;//Equirectangular, 2:1
+    static constexpr int LAYER_HEIGHT = 512;
+    static constexpr int MIP_LEVELS = 10;//Down to 2x1
+
+    PlanetTextureArray() = default;
+    ~PlanetTextureArray();
+    PlanetTextureArray(const PlanetTextureArray&) = delete;
+    PlanetTextureArray& operator=(const PlanetTextureArray&) = delete;
+
+    //Layer holding the image at path, loaded and queued for upload the first time it is asked for
+    //Bodies sharing a surface share its layer
+    int layer(const std::string& path);
+    int layerCount() const { return static_cast<int>(m_layers.size()); }
+
+    //Upload the layers queued since the last call, reallocating the array when they don't fit. Nothing to do
+    //on most frames. Needs a current GL context
+    void upload();
+    GLuint texture() const { return m_texture; }
+    int uploadedLayers() const { return m_uploaded; }//By the last upload()
+
+private:
+    //A source image packed to the layer size, level 0 first
+    struct PendingLayer {
+        int layer;
+        std::vector<std::vector<unsigned char>> mips;
+    };
+
+    std::map<std::string, int> m_layers;
+    std::vector<PendingLayer> m_pending;
+    GLuint m_texture = 0;
+    int m_capacity = 0;//Layers allocated in m_texture
+    int m_uploaded = 0;
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+//Included by the AVX2 and AVX-512 translation units, keep glm and BodyBvh out of it (see PacketPlanets)
+namespace BodyBvh { struct Tree; }
+
+//Structure-of-arrays batch of rays for the SIMD RK4 kernel
+//AVX-512 advances all 16 lanes at once, AVX2 two halves of 8, the scalar path one lane at a time
+constexpr int PACKET_LANES = 16;
+
+//Why a lane stopped, the tracer handles the event then sets the lane back to Active to resume it
+enum LaneStatus : int32_t {
+    LANE_ACTIVE = 0,
+    LANE_CAPTURED,//Crossed the event horizon
+    LANE_DISK,//Inside the disk band, shade it and resume with LANE_SKIP_DISK set
+    LANE_PLANET,//Stepped into a planet (index in planet[]), the position is where it entered
+    LANE_ESCAPED,//Past the escape radius, or LANE_ANALYTIC_ESCAPE set
+    LANE_STEP_LIMIT,//Used up maxSteps
+    LANE_DONE//Finished or unused, ignored by the kernel
+};
+
+//Per-lane flag bits
+enum LaneFlags : uint32_t {
+    LANE_NEAR_PHOTON_SPHERE = 1u << 0,
+    LANE_SKIP_DISK = 1u << 1,//Disk test already handled for the current position
+    LANE_ANALYTIC_ESCAPE = 1u << 2//Stopped outbound past every feature, the tracer bends dir the rest of the way
+};
+
+struct alignas(64) RayPacket {
+    float px[PACKET_LANES], py[PACKET_LANES], pz[PACKET_LANES];
+    float dx[PACKET_LANES], dy[PACKET_LANES], dz[PACKET_LANES];
+    int32_t status[PACKET_LANES];
+    int32_t steps[PACKET_LANES];
+    int32_t planet[PACKET_LANES];
+    uint32_t flags[PACKET_LANES];
+    uint64_t issuedSteps = 0;//Lane steps the kernel paid for, active or idle, steps over this is its SIMD utilisation
+};
+
+//Planet hierarchy as the kernel reads it, a BodyBvh::Tree flattened into plain arrays by RayPackets::flattenPlanets.
+//The AVX2 and AVX-512 kernels are compiled with those instruction sets, any inline function they shared with the
+//rest of the program (glm, std::vector, BodyBvh) could be emitted there and kept by the linker for every caller
+struct PacketPlanets {
+    const float* spheres = nullptr;//Bodies by index, centre x, y, z and radius
+    const float* nodeBounds = nullptr;//Min x, y, z and max x, y, z per node
+    const float* nodeSpheres = nullptr;//Centre and radius per node, BodyBvh::boundingSphere of its bounds
+    const int32_t* nodeFirst = nullptr;//Leaf: first entry in indices, inner node: right child
+    const int32_t* nodeCount = nullptr;//Bodies in a leaf, 0 for an inner node
+    const int32_t* indices = nullptr;//Body indices in leaf order
+    int bodies = 0;//0 for none
+};
+
+//What a PacketPlanets points into, it has to outlive the kernel calls
+struct PacketPlanetArrays {
+    std::vector<float> spheres, nodeBounds, nodeSpheres;
+    std::vector<int32_t> nodeFirst, nodeCount, indices;
+};
+
+//Scene constants the kernel tests against every step (same checks as the geodesic.comp loop)
+struct PacketParams {
+    float rs = 0.0f;
+    float stepSize = 0.1f;
+    float escapeRadius = 3000.0f;
+    float diskBand = 0.1f;//|y| below this counts as inside the disk plane
+    float diskInnerRadius = 0.0f;
+    float diskOuterRadius = 0.0f;
+    PacketPlanets planets;//Spheres and their hierarchy
+    int maxSteps = 2000;
+    bool analyticEscape = false;//Stop lanes that can no longer hit the disk or a planet (TraceScene::analyticEscape)
+};
+
+enum class PacketIsa { Scalar, AVX2, AVX512 };
+
+namespace RayPackets {
+    //Widest instruction set supported by both the CPU and the OS
+    PacketIsa detectIsa();
+    const char* isaName(PacketIsa isa);
+
+    //Copy tree into arrays and point the kernel's view at them
+    PacketPlanets flattenPlanets(const BodyBvh::Tree& tree, PacketPlanetArrays& arrays);
+
+    //Step every active lane until it stops on an event or reaches maxSteps
+    //Returns the number of RK4 steps taken across all lanes
+    uint64_t advance(PacketIsa isa, RayPacket& packet, const PacketParams& params);
+
+    //Per-ISA kernels, only call the SIMD ones when detectIsa() reports support
+    uint64_t advanceScalar(RayPacket& packet, const PacketParams& params);
+    uint64_t advanceAvx2(RayPacket& packet, const PacketParams& params);
+    uint64_t advanceAvx512(RayPacket& packet, const PacketParams& params);
+}
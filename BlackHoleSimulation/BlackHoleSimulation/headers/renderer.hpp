@@ -2,9 +2,19 @@
 #include <string>
 #include "../headers/camera.hpp"
 #include "../headers/grid.hpp"
+#include "../headers/physics.hpp"
+#include "../headers/lensingAtlas.hpp"
+#include "../headers/bodyBvh.hpp"
+#include "../headers/planetTextures.hpp"
+#include "../headers/frameRing.hpp"
+#include "../headers/glHelpers.hpp"
+#include "../headers/bloom.hpp"
+#include "../headers/hdrFormat.hpp"
+#include "../headers/debugOverlay.hpp"
 #include <glad/glad.h>
 #include <vector>
 #include <string>
+#include <chrono>
 
 //Forward declaration
 class App;
@@ -16,11 +26,19 @@ struct PlanetBlock {
     float _pad;
 };
 
+//std430 layout of PlanetData in geodesic.comp and geodesicShade.comp
+struct PlanetDataGPU {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    GLint texture;//Layer of uPlanetTextures, -1 for the plain colour
+};
+
 struct Planet {
     glm::vec3 position;
     float radius;
     glm::vec3 color;
-    GLuint texture;
+    int textureLayer = -1;//In Renderer::m_planetTextures, -1 for the plain colour
     std::string texturePath;
 
     //Orbital parameters
@@ -33,14 +51,35 @@ struct Planet {
 
 class Renderer {
 public:
-    Renderer(int width, int height);
+    //atlasPath is the lensing atlas to map, empty integrates the deflection table every frame
+    Renderer(int width, int height, HdrFormat hdrFormat = HdrFormat::RGBA32F, const std::string& atlasPath = "lensingAtlas.bin");
     ~Renderer();
 
+    //Print each HDR format's target memory and per-frame traffic at width x height, marking inUse (--hdr-report)
+    static void reportHdrTargets(int width, int height, HdrFormat inUse);
+
     void render(const Camera& camera, float fps);//called every frame
     void toggleGrid() { m_showGrid = !m_showGrid; }
-    void renderDebugText(const std::vector<std::string>& lines);
     const std::vector<Planet>& getPlanets() const;
     void toggleDebugText() { m_showDebugText = !m_showDebugText; }
+    //Framebuffer the composite, grid and debug text draw into, 0 (the default) is the window's
+    void setOutputFramebuffer(GLuint framebuffer) { m_outputFramebuffer = framebuffer; }
+
+    //Ray integrator used by geodesic.comp, tolerance only applies to the adaptive one
+    void toggleIntegrator();//Cycles RK4 -> Dormand-Prince -> Binet
+    void scaleTolerance(float factor);
+    void toggleAnalyticEscape() { m_analyticEscape = !m_analyticEscape; }
+    void toggleClassifyRays() { m_classifyRays = !m_classifyRays; }
+    void toggleDeflectionLut() { m_deflectionLut = !m_deflectionLut; }
+    void toggleLensingCubemap() { m_lensingCubemap = !m_lensingCubemap; }
+    void toggleTemporalReprojection() { m_temporalReprojection = !m_temporalReprojection; }
+    void toggleVariableRate() { m_variableRate = !m_variableRate; }
+    void toggleAdaptiveSamples() { m_adaptiveSamples = !m_adaptiveSamples; }
+    void toggleProgressive() { m_progressive = !m_progressive; }
+    void toggleWavefront() { m_wavefront = !m_wavefront; }
+    void toggleDebrisBelt() { setDebrisBelt(m_beltBodies > 0 ? 0 : BELT_BODIES); }//Adds or removes BELT_BODIES small bodies
+    void setDebrisBelt(int bodies);//That many small bodies orbiting outside the disk (Physics::debrisBelt), 0 removes them
+    void toggleBloom() { m_bloomStrength = m_bloomStrength > 0.0f ? 0.0f : BLOOM_STRENGTH; }
 
 private:
     int m_width, m_height;
@@ -52,39 +91,149 @@ private:
     void initShaders();
 
     GLuint m_quadVAO, m_quadVBO;
-    GLuint m_shaderProgram;
-    GLuint m_computeShader;
+    ShaderProgram m_shaderProgram;
+    ShaderProgram m_computeShader;
 
     GLuint m_renderTex;
-    GLuint m_cameraUBO;
-
-    GLuint m_blackHoleUBO;
-    GLuint m_diskUBO;
+    HdrFormat m_hdrFormat;//Of m_renderTex and (at most RGBA16F) the bloom chain
+
+    //Deferred geodesic G-buffer (binding 12): geodesic.comp traces into it only when something a ray
+    //depends on changes, geodesicShade.comp shades the animated disk, sky and planets from it every frame
+    static constexpr int GBUFFER_TEXEL_BYTES = 5 * 16;//Header plus 4 disk crossings, see geodesic.comp
+    ShaderProgram m_shadeShader;
+    GLuint m_gbufferSSBO = 0;
+    std::vector<float> m_traceInputs;//Hole, disk, planets and ray settings of the current G-buffer
+    CameraUBO m_tracedCamera = {};//Camera of the current G-buffer
+    bool m_traced = false;//This frame ran the trace pass
+    GLuint m_tracedPixels = 0;//Rays of the latest trace pass
+
+    //Temporal reprojection (reproject.comp): when only the camera moved, the previous G-buffer (binding 13) is
+    //carried over along each pixel's motion and geodesic.comp traces just the pixels listed in binding 14
+    ShaderProgram m_reprojectShader;
+    GLuint m_prevGbufferSSBO = 0;
+    GLuint m_traceListSSBO = 0;
+    bool m_temporalReprojection = true;
+    int m_reprojectFrame = 0;
+    GLuint m_tracedBeforeList = 0;//Rays traced ahead of the list, added to its count
+
+    //List counts for the overlay, only taken while it is shown. The GPU copies them into m_countReadback (trace
+    //list, sample list) and they are read once m_countFence has signalled, polled each frame and never waited for
+    GLuint m_countReadback = 0;
+    GLsync m_countFence = nullptr;
+    bool m_traceCountPending = false;//Slot 0 holds the trace list's count, m_pendingBeforeList still to be added
+    bool m_sampleCountPending = false;//Slot 1 holds the sample list's count
+    GLuint m_pendingBeforeList = 0;
+
+    //Variable rate (refine.comp): full traces only cover every 4th pixel each way, cells whose corners agree
+    //are interpolated and the rest listed in binding 14 for a full-rate trace
+    static constexpr int VARIABLE_RATE_STEP = 4;//TILE in refine.comp
+    ShaderProgram m_refineShader;
+    bool m_variableRate = true;
+
+    //Adaptive supersampling (supersample.comp): after a full screen trace the photon ring and edge pixels get extra
+    //rays, traced through their own list into the sample G-buffer (binding 16) and averaged in by geodesicShade.comp
+    ShaderProgram m_supersampleShader;
+    GLuint m_sampleIndexSSBO = 0;//Binding 15, each pixel's slots
+    GLuint m_sampleGbufferSSBO = 0;
+    GLuint m_sampleListSSBO = 0;
+    GLuint m_sampleBudget = 0;//Slots, half a ray per pixel
+    bool m_adaptiveSamples = true;
+    bool m_samplesValid = false;//The sample G-buffer belongs to the current G-buffer
+    GLuint m_extraSamples = 0;//Rays the latest supersample pass spent
+
+    //Wavefront mode: each geodesic.comp dispatch marches WAVEFRONT_CHUNK steps per ray, the rays still going wait
+    //in the ray pool (binding 19) and ping-pong between two queues (bindings 17 and 18), every further chunk is
+    //dispatched indirectly over just the survivors
+    static constexpr int MARCH_STEPS = 2000;//MAX_STEPS in geodesic.comp
+    static constexpr int WAVEFRONT_CHUNK = 200;
+    static constexpr int RAY_STATE_BYTES = 12 * 16;//QueuedRay in geodesic.comp
+    //The pool holds 1 / RAY_POOL_SHARE of the pixels, room for what is left of a screen's trace after the first
+    //chunk. Traces larger than the screen (the lensing cubemap) overflow it and are dispatched without chunks
+    static constexpr int RAY_POOL_SHARE = 4;
+    static_assert(MARCH_STEPS % WAVEFRONT_CHUNK == 0, "The last chunk must end on the step limit");
+    GLuint m_rayQueueSSBO[2] = { 0, 0 };//[1] is filled by the next dispatch
+    GLuint m_rayPoolSSBO = 0;
+    GLuint m_rayPoolSize = 0;//Rays
+    bool m_wavefront = true;
+
+    //Progressive accumulation: while nothing changes, each frame traces the whole screen again at the next
+    //Sobol subpixel offset and geodesicShade.comp blends it into m_renderTex's running mean. The animation
+    //holds still meanwhile, and after ACCUMULATION_FRAMES frames the image is left as it is
+    static constexpr int ACCUMULATION_FRAMES = 256;
+    bool m_progressive = false;
+    int m_accumFrames = 0;//Frames in m_renderTex's mean
+    float m_time = 0.0f;//Animation time, held while accumulating
+    std::chrono::steady_clock::time_point m_startTime = std::chrono::steady_clock::now();//m_time counts from here
+
+    //Lensing cubemap mode: the trace covers a cube around the camera position instead of the screen,
+    //so turning the camera only resamples it. 6 * 512^2 texels, about 126 MB, allocated on first use
+    static constexpr int CUBEMAP_SIZE = 512;
+    bool m_lensingCubemap = false;
+    GLuint m_cubemapSSBO = 0;
+
+    //Persistently mapped, triple-buffered upload ring for everything rewritten every frame
+    FrameRing m_frameData;
 
-    GLuint m_planetUBO;
-    GLuint m_planetSSBO = 0;
     std::vector<Planet> m_planets;
+    PlanetTextureArray m_planetTextures;//Surfaces of every textured planet, one layer each
+
+    //Planet hierarchy (BvhNodes and BvhIndices, bindings 20 and 21), rebuilt every frame after the orbits move
+    //so geodesic.comp tests each step against O(log planets) bounds
+    BodyBvh::Tree m_planetTree;
+
+    //Debris belt: m_beltBodies bodies past the disk appended to m_planets, the first m_basePlanets are the scene's own
+    static constexpr int BELT_BODIES = 4096;//What the B key adds
+    size_t m_basePlanets = 0;
+    int m_beltBodies = 0;
 
-    GLuint m_timeUBO;
     GLuint m_smokeTex = 0;
 	GLuint m_skyboxTex = 0;
 
-    GLuint m_debugTextShader = 0;
-    GLuint m_debugTextVBO = 0, m_debugTextVAO = 0;
+    DebugOverlay m_debugOverlay;
+    std::vector<std::string> m_debugLines;//Reused every frame
     bool m_showDebugText = true;
-
-    GLuint m_bloomExtractTex = 0, m_bloomBlurTex[2] = { 0, 0 };
-    GLuint m_bloomExtractFBO = 0, m_bloomBlurFBO[2] = { 0, 0 };
-    GLuint m_bloomExtractShader = 0, m_bloomBlurShader = 0;
+    GLuint m_outputFramebuffer = 0;
+
+    IntegratorType m_integrator = IntegratorType::RK4;
+    float m_tolerance = 1e-5f;
+    bool m_analyticEscape = true;
+    bool m_classifyRays = true;
+
+    //Deflection table pass (deflectionLut.comp), rebuilt every frame ahead of geodesic.comp
+    ShaderProgram m_lutShader;
+    GLuint m_lutRowsSSBO = 0, m_lutSamplesSSBO = 0;
+    bool m_deflectionLut = true;
+    glm::vec4 m_lutInputs = glm::vec4(-1.0f);//Camera radius, max angle, rs and source of the current table
+
+    //Lensing atlas mapped from lensingAtlas.bin, atlasResample.comp reads the table off it instead
+    //of integrating while it covers the camera radius
+    LensingAtlas m_atlas;
+    ShaderProgram m_atlasShader;
+    GLuint m_atlasOrbitsSSBO = 0, m_atlasSamplesSSBO = 0;
+    bool m_atlasInUse = false;//Last frame's table came from the atlas
+
+    //Bloom chain (level 0 written by the shade pass), composited at m_bloomStrength. At 0 (off) none of its passes run
+    static constexpr float BLOOM_STRENGTH = 0.6f;//When turned on
+    static constexpr float BLOOM_THRESHOLD = 0.8f;
+    Bloom m_bloom;
+    float m_bloomStrength = 0.0f;
+    bool m_bloomCurrent = false;//The chain ran on the current m_renderTex, level 0 holds the result
 
 	float bhRadiusSim;
     double m_bhMass;
     double scale;
 
-    void initUBO();
-    void initBlackHoleUBO();
     void initRenderTexture();
-    void initBloomTextures();
+    void updateDebugText(const Camera& camera, float fps, bool progressive);
+    //Bytes of HDR target memory and of target reads and writes in one frame at this size
+    static size_t hdrTargetBytes(HdrFormat format, int width, int height);
+    static size_t hdrFrameTraffic(HdrFormat format, int width, int height, bool bloom);
+    void initGBuffer();
+    void clearTraceList(GLuint list);
+    void dispatchTrace(GLuint groupsX, GLuint groupsY, GLuint groupsZ, GLuint indirectList = 0);
+    void copyListCount(GLuint list, int slot);
+    void readListCounts();
+    void initDeflectionLut(const std::string& atlasPath);
 };
 
 struct BlackHoleUBO {
@@ -92,9 +241,11 @@ struct BlackHoleUBO {
     float bhRadius;
 };
 
+//std140: the vec3 starts on a 16 byte boundary
 struct DiskBlock {
     float diskInnerRadius;
     float diskOuterRadius;
+    float _pad0[2];
     glm::vec3 diskColor;
     float _pad;
 };
\ No newline at end of file
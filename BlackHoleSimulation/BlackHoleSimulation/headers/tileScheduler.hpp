@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+
+//Persistent worker pool that hands out image tiles with work stealing
+//Each worker starts with a contiguous block of tiles and steals from the back of
+//other workers' queues once its own runs dry, so slow tiles (rays orbiting the
+//photon sphere) don't leave the other cores idle
+class TileScheduler {
+public:
+    //Called once per tile: tile x, tile y, worker index
+    using TileFn = std::function<void(int, int, unsigned)>;
+
+    explicit TileScheduler(unsigned threadCount = 0);//0 = one worker per hardware thread
+    ~TileScheduler();
+
+    TileScheduler(const TileScheduler&) = delete;
+    TileScheduler& operator=(const TileScheduler&) = delete;
+
+    //Run fn over every tile of a tilesX x tilesY grid, blocks until all tiles are done
+    //The calling thread works as worker 0
+    void run(int tilesX, int tilesY, const TileFn& fn);
+
+    unsigned threadCount() const { return m_threadCount; }
+    unsigned long long stealCount() const { return m_steals.load(); }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<int> tiles;
+    };
+
+    void workerLoop(unsigned worker);
+    void drain(unsigned worker);
+    bool popLocal(unsigned worker, int& tile);
+    bool steal(unsigned worker, int& tile);
+
+    unsigned m_threadCount;
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+
+    //Current job, published under m_mutex
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const TileFn* m_fn = nullptr;
+    int m_tilesX = 0;
+    unsigned long long m_generation = 0;
+    unsigned m_busyWorkers = 0;
+    bool m_quit = false;
+
+    std::atomic<int> m_remaining{ 0 };
+    std::atomic<unsigned long long> m_steals{ 0 };
+};
@@ -16,8 +16,8 @@ void main() {
     //Sample the main scene color
     vec3 scene = texture(uRenderTex, TexCoords).rgb;
 
-    //Sample the bloom texture
-    vec3 bloom = texture(uBloomTex, TexCoords).rgb;
+    //Sample the bloom texture, not at all while bloom is off
+    vec3 bloom = uBloomStrength > 0.0 ? texture(uBloomTex, TexCoords).rgb : vec3(0.0);
 
     //Combine the scene and bloom, apply bloom strength, output final color
     FragColor = vec4(scene + bloom * uBloomStrength, 1.0);
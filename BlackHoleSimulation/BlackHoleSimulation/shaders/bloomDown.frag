@@ -0,0 +1,23 @@
+#version 430 core
+
+//Interpolated values from the vertex shaders
+in vec2 TexCoords;
+
+//Output color of the pixel
+out vec4 FragColor;
+
+//The level above, level 0 comes thresholded from geodesicShade.comp
+uniform sampler2D uSource;
+
+void main() {
+    //One source texel, each tap lands on a texel corner so the bilinear fetch averages 2x2 of them
+    vec2 texel = 1.0 / vec2(textureSize(uSource, 0));
+
+    //Dual-filter downsample: the centre block weighted 4, the four diagonal blocks 1 each
+    vec3 color = texture(uSource, TexCoords).rgb * 4.0;
+    color += texture(uSource, TexCoords + vec2(-texel.x, -texel.y)).rgb;
+    color += texture(uSource, TexCoords + vec2( texel.x, -texel.y)).rgb;
+    color += texture(uSource, TexCoords + vec2(-texel.x,  texel.y)).rgb;
+    color += texture(uSource, TexCoords + vec2( texel.x,  texel.y)).rgb;
+    FragColor = vec4(color * (1.0 / 8.0), 1.0);
+}
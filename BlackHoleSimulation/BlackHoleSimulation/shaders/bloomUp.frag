@@ -0,0 +1,27 @@
+#version 430 core
+
+//Interpolated values from the vertex shaders
+in vec2 TexCoords;
+
+//Output color of the pixel, added to the level's own by the blend
+out vec4 FragColor;
+
+//The smaller level below
+uniform sampler2D uSource;
+
+void main() {
+    //One source texel
+    vec2 texel = 1.0 / vec2(textureSize(uSource, 0));
+
+    //Dual-filter upsample, a tent: four taps a texel out along the axes weighted 1, four diagonal ones half
+    //a texel out weighted 2
+    vec3 color = texture(uSource, TexCoords + vec2(-texel.x, 0.0)).rgb;
+    color += texture(uSource, TexCoords + vec2( texel.x, 0.0)).rgb;
+    color += texture(uSource, TexCoords + vec2(0.0, -texel.y)).rgb;
+    color += texture(uSource, TexCoords + vec2(0.0,  texel.y)).rgb;
+    color += texture(uSource, TexCoords + 0.5 * vec2(-texel.x, -texel.y)).rgb * 2.0;
+    color += texture(uSource, TexCoords + 0.5 * vec2( texel.x, -texel.y)).rgb * 2.0;
+    color += texture(uSource, TexCoords + 0.5 * vec2(-texel.x,  texel.y)).rgb * 2.0;
+    color += texture(uSource, TexCoords + 0.5 * vec2( texel.x,  texel.y)).rgb * 2.0;
+    FragColor = vec4(color * (1.0 / 12.0), 1.0);
+}
@@ -0,0 +1,317 @@
+/*
+	Double precision reference integrator and the error harness for the faster integrator modes
+*/
+
+#include "../headers/accuracy.hpp"
+#include "../headers/physics.hpp"
+#include "../headers/tileScheduler.hpp"
+#include "../headers/deflectionLut.hpp"
+#include "../headers/lensingAtlas.hpp"
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+
+//----------------- Reference -----------------
+//RK4 in phi with a fixed 1e-4 rad step, the truncation error is far below float precision
+static const double REFERENCE_STEP = 1e-4;
+//Rays still orbiting after this many turns sit on the photon sphere, count them as captured
+static const double REFERENCE_MAX_PHI = 16.0 * 3.14159265358979323846;
+
+RayOutcome Accuracy::traceReference(const glm::dvec3& pos, const glm::dvec3& dir, double rs) {
+    RayOutcome outcome;
+    double r0 = glm::length(pos);
+    glm::dvec3 e1 = pos / r0;
+    glm::dvec3 d = glm::normalize(dir);
+    double dr = glm::dot(d, e1);
+
+    //Orbital plane spanned by the radial direction and the tangential part of the ray
+    glm::dvec3 tangent = d - dr * e1;
+    double dt = glm::length(tangent);
+    if (dt < 1e-12) {
+        //Radial ray, no bending
+        outcome.captured = dr < 0.0;
+        outcome.direction = d;
+        return outcome;
+    }
+    glm::dvec3 e2 = tangent / dt;
+
+    //u = 1/r, w = du/dphi = -u * (dr/dt)
+    double u = 1.0 / r0;
+    double w = -u * dr / dt;
+    double phi = 0.0;
+    double uHorizon = 1.0 / rs;
+    double k = 1.5 * rs;
+    const double h = REFERENCE_STEP;
+
+    auto f = [k](double u) { return -u + k * u * u; };
+
+    while (phi < REFERENCE_MAX_PHI) {
+        double k1u = w, k1w = f(u);
+        double k2u = w + 0.5 * h * k1w, k2w = f(u + 0.5 * h * k1u);
+        double k3u = w + 0.5 * h * k2w, k3w = f(u + 0.5 * h * k2u);
+        double k4u = w + h * k3w, k4w = f(u + h * k3u);
+        double nu = u + h / 6.0 * (k1u + 2.0 * k2u + 2.0 * k3u + k4u);
+        double nw = w + h / 6.0 * (k1w + 2.0 * k2w + 2.0 * k3w + k4w);
+        ++outcome.steps;
+
+        if (nu <= 0.0) {
+            //Reached infinity inside this step, the asymptote is the radial direction there
+            double phiInf = phi + h * u / (u - nu);
+            outcome.direction = std::cos(phiInf) * e1 + std::sin(phiInf) * e2;
+            return outcome;
+        }
+        if (nu >= uHorizon) {
+            outcome.captured = true;
+            return outcome;
+        }
+        u = nu;
+        w = nw;
+        phi += h;
+    }
+
+    outcome.captured = true;
+    return outcome;
+}
+
+//----------------- Modes -----------------
+//Without disk and planets the analytic escape test reduces to outbound past this many rs,
+//about where the default scene's disk ends
+static const float ESCAPE_RADIUS_RS = 10.0f;
+
+static bool analyticEscape(const glm::vec3& pos, const glm::vec3& dir, float r, float rs) {
+    return glm::dot(pos, dir) > 0.0f && r > ESCAPE_RADIUS_RS * rs;
+}
+
+//The renderer's loop without disk and planets: rk4Step until capture, escape or the step budget
+//Cheaper variants take longer steps over the same 200 unit path
+static IntegratorMode rk4Mode(float stepSize, int maxSteps, bool escape = false) {
+    IntegratorMode mode;
+    char name[64];
+    std::snprintf(name, sizeof(name), "rk4 h=%.2f%s", stepSize, escape ? " +escape" : "");
+    mode.name = name;
+    mode.trace = [stepSize, maxSteps, escape](const glm::vec3& origin, const glm::vec3& rayDir, float rs) {
+        RayOutcome outcome;
+        glm::vec3 pos = origin;
+        glm::vec3 dir = rayDir;
+        for (int i = 0; i < maxSteps; ++i) {
+            float r = glm::length(pos);
+            if (r < rs) {
+                outcome.captured = true;
+                break;
+            }
+            if (escape && analyticEscape(pos, dir, r, rs)) {
+                dir = Physics::escapeDirection(pos, dir, rs);
+                break;
+            }
+            if (r > 3000.0f) break;
+            Physics::rk4Step(pos, dir, stepSize, rs);
+            ++outcome.steps;
+        }
+        outcome.direction = glm::dvec3(dir);
+        return outcome;
+    };
+    return mode;
+}
+
+//Adaptive Dormand-Prince loop, steps bounded by the distance to the photon sphere shell like
+//the renderer (disk and planets are not part of the vacuum test)
+static IntegratorMode dopri5Mode(float tolerance) {
+    IntegratorMode mode;
+    char name[64];
+    std::snprintf(name, sizeof(name), "dopri5 tol=%.0e", tolerance);
+    mode.name = name;
+    mode.trace = [tolerance](const glm::vec3& origin, const glm::vec3& rayDir, float rs) {
+        RayOutcome outcome;
+        glm::vec3 pos = origin;
+        glm::vec3 dir = rayDir;
+        glm::vec3 accel = Physics::schwarzschildAccel(pos, rs);
+        float h = 0.1f;
+        for (int i = 0; i < 2000; ++i) {
+            float r = glm::length(pos);
+            if (r < rs) {
+                outcome.captured = true;
+                break;
+            }
+            if (r > 3000.0f) break;
+            float maxStep = std::max(0.1f, std::fabs(r - 1.5f * rs));
+            outcome.steps += Physics::dopri5Step(pos, dir, accel, h, maxStep, rs, tolerance);
+        }
+        outcome.direction = glm::dvec3(dir);
+        return outcome;
+    };
+    return mode;
+}
+
+//Binet equation in the orbital plane over the same 200 unit path as rk4Mode
+static IntegratorMode binetMode(float stepSize, int maxSteps, bool escape = false) {
+    IntegratorMode mode;
+    char name[64];
+    std::snprintf(name, sizeof(name), "binet h=%.2f%s", stepSize, escape ? " +escape" : "");
+    mode.name = name;
+    mode.trace = [stepSize, maxSteps, escape](const glm::vec3& origin, const glm::vec3& rayDir, float rs) {
+        RayOutcome outcome;
+        glm::vec3 pos = origin;
+        glm::vec3 dir = rayDir;
+        OrbitState orbit;
+        bool binet = Physics::orbitFromRay(pos, dir, orbit);
+        for (int i = 0; i < maxSteps; ++i) {
+            float r = glm::length(pos);
+            if (r < rs) {
+                outcome.captured = true;
+                break;
+            }
+            if (escape && analyticEscape(pos, dir, r, rs)) {
+                dir = binet ? Physics::binetEscapeDirection(orbit, rs) : Physics::escapeDirection(pos, dir, rs);
+                break;
+            }
+            if (r > 3000.0f) break;
+            ++outcome.steps;
+            if (!binet) {
+                Physics::rk4Step(pos, dir, stepSize, rs);
+                continue;
+            }
+            Physics::binetStep(orbit, Physics::binetAngleStep(orbit, stepSize), rs);
+            if (orbit.u <= 0.0f) break;
+            Physics::orbitToRay(orbit, pos, dir);
+        }
+        outcome.direction = glm::dvec3(dir);
+        return outcome;
+    };
+    return mode;
+}
+
+//Impact parameter pre-pass in front of another mode, which only gets the rays it can't settle
+static IntegratorMode classified(const IntegratorMode& inner, bool binet) {
+    IntegratorMode mode;
+    mode.name = inner.name + " +classify";
+    auto trace = inner.trace;
+    mode.trace = [trace, binet](const glm::vec3& origin, const glm::vec3& rayDir, float rs) {
+        ImpactSweep sweep;
+        switch (Physics::classifyImpact(origin, rayDir, rs, binet, 3.0f * rs, ESCAPE_RADIUS_RS * rs, sweep)) {
+        case RayFate::Captured: {
+            RayOutcome outcome;
+            outcome.captured = true;
+            return outcome;
+        }
+        case RayFate::Escapes: {
+            RayOutcome outcome;
+            outcome.direction = glm::dvec3(std::cos(sweep.phiEscape) * sweep.e1 + std::sin(sweep.phiEscape) * sweep.e2);
+            return outcome;
+        }
+        default:
+            return trace(origin, rayDir, rs);
+        }
+    };
+    return mode;
+}
+
+//Deflection table lookup, rays past the table's widest angle fall back to the inner mode
+//One table per start radius, covering every direction, built on first use, resampled from the atlas if given
+static IntegratorMode tabled(const IntegratorMode& inner, bool binet, const LensingAtlas* atlas = nullptr) {
+    IntegratorMode mode;
+    mode.name = inner.name + (atlas ? " +atlas" : " +table");
+    auto trace = inner.trace;
+    auto tables = std::make_shared<std::map<std::pair<float, float>, DeflectionLut::Table>>();
+    auto lock = std::make_shared<std::mutex>();
+    mode.trace = [trace, binet, atlas, tables, lock](const glm::vec3& origin, const glm::vec3& rayDir, float rs) {
+        const DeflectionLut::Table* table;
+        {
+            std::lock_guard<std::mutex> guard(*lock);
+            std::pair<float, float> key(glm::length(origin), rs);
+            auto found = tables->find(key);
+            if (found == tables->end()) {
+                found = tables->emplace(key, DeflectionLut::Table()).first;
+                if (!atlas || !DeflectionLut::resample(*atlas, rs, key.first, 3.14159265f, binet, found->second)) {
+                    DeflectionLut::build(rs, key.first, 3.14159265f, binet, found->second);
+                }
+            }
+            table = &found->second;
+        }
+
+        DeflectionLut::Lookup ray;
+        if (!DeflectionLut::lookup(*table, origin, rayDir, ray)) return trace(origin, rayDir, rs);
+        RayOutcome outcome;
+        outcome.captured = ray.captured;
+        outcome.direction = glm::dvec3(ray.asymptote());
+        return outcome;
+    };
+    return mode;
+}
+
+const std::vector<IntegratorMode>& Accuracy::modes() {
+    static const std::vector<IntegratorMode> registry = {
+        rk4Mode(0.1f, 2000),//STEP_SIZE and MAX_STEPS of geodesic.comp
+        rk4Mode(0.2f, 1000),
+        rk4Mode(0.4f, 500),
+        rk4Mode(0.8f, 250),
+        rk4Mode(0.1f, 2000, true),
+        classified(rk4Mode(0.1f, 2000, true), false),
+        tabled(rk4Mode(0.1f, 2000, true), false),
+        dopri5Mode(1e-4f),
+        dopri5Mode(1e-5f),//Renderer default
+        dopri5Mode(1e-6f),
+        binetMode(0.1f, 2000),
+        binetMode(0.4f, 500),
+        binetMode(0.1f, 2000, true),
+        classified(binetMode(0.1f, 2000, true), true),
+        tabled(binetMode(0.1f, 2000, true), true)
+    };
+    return registry;
+}
+
+std::vector<IntegratorMode> Accuracy::atlasModes(const LensingAtlas& atlas) {
+    return {
+        tabled(rk4Mode(0.1f, 2000, true), false, &atlas),
+        tabled(binetMode(0.1f, 2000, true), true, &atlas)
+    };
+}
+
+//----------------- Harness -----------------
+AccuracyReport Accuracy::measure(const IntegratorMode& mode, const std::vector<glm::vec3>& origins, const std::vector<glm::vec3>& dirs,
+    const std::vector<RayOutcome>& reference, float rs, unsigned threadCount) {
+    const int count = static_cast<int>(dirs.size());
+    const int CHUNK = 64;
+    std::vector<RayOutcome> outcomes(count);
+
+    TileScheduler scheduler(threadCount);
+    auto start = std::chrono::steady_clock::now();
+    scheduler.run((count + CHUNK - 1) / CHUNK, 1, [&](int chunk, int, unsigned) {
+        int end = std::min(count, (chunk + 1) * CHUNK);
+        for (int i = chunk * CHUNK; i < end; ++i) {
+            outcomes[i] = mode.trace(origins[i], dirs[i], rs);
+        }
+    });
+
+    AccuracyReport report;
+    report.name = mode.name;
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report.rays = count;
+
+    std::vector<double> errors;
+    for (int i = 0; i < count; ++i) {
+        report.steps += outcomes[i].steps;
+        if (outcomes[i].captured != reference[i].captured) {
+            if (outcomes[i].captured) ++report.falseCaptures;
+            else ++report.falseEscapes;
+            continue;
+        }
+        if (reference[i].captured) continue;
+
+        double c = glm::dot(glm::normalize(outcomes[i].direction), reference[i].direction);
+        errors.push_back(std::acos(std::min(1.0, std::max(-1.0, c))));
+    }
+
+    if (!errors.empty()) {
+        double sum = 0.0;
+        for (double e : errors) sum += e;
+        report.meanError = sum / errors.size();
+        std::sort(errors.begin(), errors.end());
+        report.p99Error = errors[std::min(errors.size() - 1, errors.size() * 99 / 100)];
+        report.maxError = errors.back();
+    }
+    return report;
+}
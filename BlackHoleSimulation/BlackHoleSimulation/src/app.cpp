@@ -14,7 +14,7 @@
 #include <GLFW/glfw3.h>
 
 //----------------- Constructor -----------------
-App::App(int width, int height, const std::string& title)
+App::App(int width, int height, const std::string& title, HdrFormat hdrFormat)
     : m_width(width), m_height(height), m_title(title), m_window(nullptr),
     m_renderer(nullptr), m_camera(nullptr), m_lastFrame(0.0f)
 {
@@ -24,7 +24,7 @@ App::App(int width, int height, const std::string& title)
 	//Create camera and renderer
 	//Camera (fov, aspect, near, far)
     m_camera = new Camera(60.0f, (float)m_width / m_height, 0.1f, 10000.0f);
-    m_renderer = new Renderer(m_width, m_height);
+    m_renderer = new Renderer(m_width, m_height, hdrFormat);
 
     //Hook mouse callback
 	//Setting user pointer to camera for access in callback
@@ -121,6 +121,163 @@ void App::processInput() {
     else {
         debugKeyPressed = false;
     }
+
+	//Cycle the integrators with I, [ and ] tighten/loosen the Dormand-Prince tolerance
+    static bool integratorKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_I) == GLFW_PRESS) {
+        if (!integratorKeyPressed) {
+            m_renderer->toggleIntegrator();
+            integratorKeyPressed = true;
+        }
+    }
+    else {
+        integratorKeyPressed = false;
+    }
+
+    static bool toleranceKeyPressed = false;
+    bool tighter = glfwGetKey(m_window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS;
+    bool looser = glfwGetKey(m_window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS;
+    if (tighter || looser) {
+        if (!toleranceKeyPressed) {
+            m_renderer->scaleTolerance(tighter ? 0.1f : 10.0f);
+            toleranceKeyPressed = true;
+        }
+    }
+    else {
+        toleranceKeyPressed = false;
+    }
+
+	//Toggle the analytic escape test with X
+    static bool escapeKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_X) == GLFW_PRESS) {
+        if (!escapeKeyPressed) {
+            m_renderer->toggleAnalyticEscape();
+            escapeKeyPressed = true;
+        }
+    }
+    else {
+        escapeKeyPressed = false;
+    }
+
+	//Toggle the impact parameter pre-pass with C
+    static bool classifyKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_C) == GLFW_PRESS) {
+        if (!classifyKeyPressed) {
+            m_renderer->toggleClassifyRays();
+            classifyKeyPressed = true;
+        }
+    }
+    else {
+        classifyKeyPressed = false;
+    }
+
+	//Toggle the deflection table pass with L
+    static bool lutKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_L) == GLFW_PRESS) {
+        if (!lutKeyPressed) {
+            m_renderer->toggleDeflectionLut();
+            lutKeyPressed = true;
+        }
+    }
+    else {
+        lutKeyPressed = false;
+    }
+
+	//Toggle the lensing cubemap with V
+    static bool cubemapKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_V) == GLFW_PRESS) {
+        if (!cubemapKeyPressed) {
+            m_renderer->toggleLensingCubemap();
+            cubemapKeyPressed = true;
+        }
+    }
+    else {
+        cubemapKeyPressed = false;
+    }
+
+	//Toggle temporal reprojection with T
+    static bool reprojectKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_T) == GLFW_PRESS) {
+        if (!reprojectKeyPressed) {
+            m_renderer->toggleTemporalReprojection();
+            reprojectKeyPressed = true;
+        }
+    }
+    else {
+        reprojectKeyPressed = false;
+    }
+
+	//Toggle variable-rate tracing with R
+    static bool variableRateKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_R) == GLFW_PRESS) {
+        if (!variableRateKeyPressed) {
+            m_renderer->toggleVariableRate();
+            variableRateKeyPressed = true;
+        }
+    }
+    else {
+        variableRateKeyPressed = false;
+    }
+
+	//Toggle adaptive supersampling with M
+    static bool supersampleKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_M) == GLFW_PRESS) {
+        if (!supersampleKeyPressed) {
+            m_renderer->toggleAdaptiveSamples();
+            supersampleKeyPressed = true;
+        }
+    }
+    else {
+        supersampleKeyPressed = false;
+    }
+
+	//Toggle progressive accumulation with P
+    static bool progressiveKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_P) == GLFW_PRESS) {
+        if (!progressiveKeyPressed) {
+            m_renderer->toggleProgressive();
+            progressiveKeyPressed = true;
+        }
+    }
+    else {
+        progressiveKeyPressed = false;
+    }
+
+	//Toggle wavefront ray scheduling with K
+    static bool wavefrontKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_K) == GLFW_PRESS) {
+        if (!wavefrontKeyPressed) {
+            m_renderer->toggleWavefront();
+            wavefrontKeyPressed = true;
+        }
+    }
+    else {
+        wavefrontKeyPressed = false;
+    }
+
+	//Toggle the debris belt with B
+    static bool beltKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_B) == GLFW_PRESS) {
+        if (!beltKeyPressed) {
+            m_renderer->toggleDebrisBelt();
+            beltKeyPressed = true;
+        }
+    }
+    else {
+        beltKeyPressed = false;
+    }
+
+	//Toggle bloom with N
+    static bool bloomKeyPressed = false;
+    if (glfwGetKey(m_window, GLFW_KEY_N) == GLFW_PRESS) {
+        if (!bloomKeyPressed) {
+            m_renderer->toggleBloom();
+            bloomKeyPressed = true;
+        }
+    }
+    else {
+        bloomKeyPressed = false;
+    }
 }
 
 //----------------- Run -----------------
@@ -0,0 +1,111 @@
+/*
+	Bloom
+	Dual-filter bloom down and back up a chain of half-float levels, level 0 comes from the shade pass
+*/
+
+#include "../headers/bloom.hpp"
+#include <algorithm>
+
+//----------------- Chain -----------------
+int Bloom::levelSizes(int width, int height, int (&sizes)[MAX_LEVELS][2]) {
+    int levelWidth = std::max(width / 2, 1), levelHeight = std::max(height / 2, 1);
+    int count = 0;
+    while (count < MAX_LEVELS && (count == 0 || std::min(levelWidth, levelHeight) >= MIN_SIZE)) {
+        sizes[count][0] = levelWidth;
+        sizes[count][1] = levelHeight;
+        ++count;
+        levelWidth = std::max(levelWidth / 2, 1);
+        levelHeight = std::max(levelHeight / 2, 1);
+    }
+    return count;
+}
+
+size_t Bloom::chainBytes(int width, int height, int bytesPerPixel) {
+    int sizes[MAX_LEVELS][2];
+    int count = levelSizes(width, height, sizes);
+    size_t total = 0;
+    for (int i = 0; i < count; ++i) {
+        total += static_cast<size_t>(sizes[i][0]) * sizes[i][1] * bytesPerPixel;
+    }
+    return total;
+}
+
+//Level 0 written once by the shade pass. Down: each level read, the next written. Up: each level read and
+//blended into the one above (read and written). The composite reads level 0
+size_t Bloom::frameTraffic(int width, int height, int bytesPerPixel) {
+    int sizes[MAX_LEVELS][2];
+    int count = levelSizes(width, height, sizes);
+    size_t texels[MAX_LEVELS] = {};
+    for (int i = 0; i < count; ++i) {
+        texels[i] = static_cast<size_t>(sizes[i][0]) * sizes[i][1];
+    }
+    size_t total = 2 * texels[0];
+    for (int i = 1; i < count; ++i) {
+        total += texels[i - 1] + texels[i];//Down
+        total += texels[i] + 2 * texels[i - 1];//Up
+    }
+    return total * static_cast<size_t>(bytesPerPixel);
+}
+
+void Bloom::init(int width, int height, HdrFormat format) {
+    const HdrFormats::Info& formatInfo = HdrFormats::info(format);
+    m_downShader = ShaderProgram(GLHelpers::loadShaderProgram("shaders/blit.vert", "shaders/bloomDown.frag"));
+    m_upShader = ShaderProgram(GLHelpers::loadShaderProgram("shaders/blit.vert", "shaders/bloomUp.frag"));
+
+    int sizes[MAX_LEVELS][2];
+    m_levelCount = levelSizes(width, height, sizes);
+    for (int i = 0; i < m_levelCount; ++i) {
+        Level& level = m_levels[i];
+        level.width = sizes[i][0];
+        level.height = sizes[i][1];
+
+        glGenTextures(1, &level.texture);
+        glBindTexture(GL_TEXTURE_2D, level.texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, formatInfo.internalFormat, level.width, level.height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &level.framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, level.framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, level.texture, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::invalidate();
+}
+
+Bloom::~Bloom() {
+    for (Level& level : m_levels) {
+        GLState::deleteTexture(level.texture);
+        if (level.framebuffer != 0) glDeleteFramebuffers(1, &level.framebuffer);
+    }
+}
+
+//----------------- Passes -----------------
+void Bloom::render(GLuint quadVAO) {
+    GLState::bindVertexArray(quadVAO);
+
+    //Down: each level into the next
+    glDisable(GL_BLEND);
+    m_downShader.use();
+    for (int i = 1; i < m_levelCount; ++i) {
+        GLState::bindFramebuffer(m_levels[i].framebuffer);
+        glViewport(0, 0, m_levels[i].width, m_levels[i].height);
+        GLState::bindTexture(0, GL_TEXTURE_2D, m_levels[i - 1].texture);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    }
+
+    //Up: each level blurred into the one above it, added to what the down pass left there
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    m_upShader.use();
+    for (int i = m_levelCount - 2; i >= 0; --i) {
+        GLState::bindFramebuffer(m_levels[i].framebuffer);
+        glViewport(0, 0, m_levels[i].width, m_levels[i].height);
+        GLState::bindTexture(0, GL_TEXTURE_2D, m_levels[i + 1].texture);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
@@ -0,0 +1,142 @@
+/*
+	Body hierarchy
+	Per-frame BVH over the orbiting bodies, uploaded for geodesic.comp and walked by the CPU tracer
+*/
+
+#include "../headers/bodyBvh.hpp"
+#include <algorithm>
+#include <cmath>
+
+//----------------- Build -----------------
+//Node over indices [first, first + count), children split at the median centre along the widest axis of the centres
+static void buildNode(BodyBvh::Tree& tree, int first, int count) {
+    int index = static_cast<int>(tree.nodes.size());
+    tree.nodes.push_back(BodyBvh::Node());
+
+    glm::vec3 boundsMin(INFINITY), boundsMax(-INFINITY);
+    glm::vec3 centreMin(INFINITY), centreMax(-INFINITY);
+    for (int i = first; i < first + count; ++i) {
+        const glm::vec4& s = tree.spheres[tree.indices[i]];
+        glm::vec3 c(s);
+        boundsMin = glm::min(boundsMin, c - s.w);
+        boundsMax = glm::max(boundsMax, c + s.w);
+        centreMin = glm::min(centreMin, c);
+        centreMax = glm::max(centreMax, c);
+    }
+    tree.nodes[index].boundsMin = boundsMin;
+    tree.nodes[index].boundsMax = boundsMax;
+
+    if (count <= BodyBvh::LEAF_BODIES) {
+        tree.nodes[index].first = first;
+        tree.nodes[index].count = count;
+        return;
+    }
+
+    glm::vec3 extent = centreMax - centreMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    int half = count / 2;
+    std::nth_element(tree.indices.begin() + first, tree.indices.begin() + first + half, tree.indices.begin() + first + count,
+        [&](int32_t a, int32_t b) { return tree.spheres[a][axis] < tree.spheres[b][axis]; });
+
+    buildNode(tree, first, half);
+    int right = static_cast<int>(tree.nodes.size());
+    buildNode(tree, first + half, count - half);
+    tree.nodes[index].first = right;
+    tree.nodes[index].count = 0;
+}
+
+void BodyBvh::build(Tree& tree) {
+    int count = static_cast<int>(tree.spheres.size());
+    tree.nodes.clear();
+    tree.nodes.reserve(std::max(2 * count / LEAF_BODIES + 1, 1));
+    tree.indices.resize(count);
+    for (int i = 0; i < count; ++i) {
+        tree.indices[i] = i;
+    }
+    if (count == 0) {
+        Node empty = {};
+        tree.nodes.push_back(empty);
+        return;
+    }
+    buildNode(tree, 0, count);
+}
+
+//----------------- Queries -----------------
+//Where the segment a + t d, t in [0, 1], enters the sphere
+static bool enterSphere(const glm::vec3& a, const glm::vec3& d, const glm::vec4& sphere, float& t) {
+    glm::vec3 oc = a - glm::vec3(sphere);
+    float c = glm::dot(oc, oc) - sphere.w * sphere.w;
+    if (c < 0.0f) {
+        t = 0.0f;
+        return true;
+    }
+    float b = glm::dot(oc, d);
+    if (b >= 0.0f) return false;//Moving away from it
+    float dd = glm::dot(d, d);
+    float disc = b * b - dd * c;
+    if (disc < 0.0f) return false;
+    t = (-b - std::sqrt(disc)) / dd;
+    return t <= 1.0f;
+}
+
+static bool overlaps(const glm::vec3& lo, const glm::vec3& hi, const BodyBvh::Node& node) {
+    return hi.x >= node.boundsMin.x && hi.y >= node.boundsMin.y && hi.z >= node.boundsMin.z
+        && lo.x <= node.boundsMax.x && lo.y <= node.boundsMax.y && lo.z <= node.boundsMax.z;
+}
+
+int BodyBvh::firstHit(const Tree& tree, const glm::vec3& a, const glm::vec3& b, float& t) {
+    if (tree.spheres.empty()) return -1;
+    glm::vec3 d = b - a;
+    glm::vec3 lo = glm::min(a, b), hi = glm::max(a, b);
+    int hit = -1;
+    t = 1.0f;//Entries right at b count for the next step
+
+    int stack[MAX_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        int index = stack[--top];
+        const Node& node = tree.nodes[index];
+        if (!overlaps(lo, hi, node)) continue;
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = index + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            int body = tree.indices[i];
+            float enter;
+            if (enterSphere(a, d, tree.spheres[body], enter) && enter < t) {
+                t = enter;
+                hit = body;
+            }
+        }
+    }
+    return hit;
+}
+
+float BodyBvh::nearestSurface(const Tree& tree, const glm::vec3& pos, float limit) {
+    if (tree.spheres.empty()) return limit;
+    float best = limit;
+
+    int stack[MAX_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        int index = stack[--top];
+        const Node& node = tree.nodes[index];
+        //A body's surface is no closer than the box around it
+        glm::vec3 outside = glm::max(glm::max(node.boundsMin - pos, pos - node.boundsMax), glm::vec3(0.0f));
+        if (glm::length(outside) >= best) continue;
+        if (node.count == 0) {
+            stack[top++] = node.first;
+            stack[top++] = index + 1;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            const glm::vec4& s = tree.spheres[tree.indices[i]];
+            best = std::min(best, glm::length(pos - glm::vec3(s)) - s.w);
+        }
+    }
+    return best;
+}
@@ -0,0 +1,130 @@
+/*
+	Debug overlay
+	Debug text batched into one vertex buffer and one draw, rebuilt line by line as the text changes
+*/
+
+#include "../headers/debugOverlay.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <limits>
+//Only stb_easy_font_print is used, the header's other static functions would warn
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include "stb_easy_font.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+//----------------- Setup -----------------
+void DebugOverlay::init() {
+    m_shader = ShaderProgram(GLHelpers::loadShaderProgram("shaders/debugText/text.vert", "shaders/debugText/text.frag"));
+
+    glGenVertexArrays(1, &m_vao);
+    glGenBuffers(1, &m_vbo);
+    glGenBuffers(1, &m_ebo);
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GLState::invalidate();
+}
+
+DebugOverlay::~DebugOverlay() {
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteBuffers(1, &m_vbo);
+    glDeleteBuffers(1, &m_ebo);
+}
+
+//----------------- Text -----------------
+void DebugOverlay::setLines(const std::vector<std::string>& lines) {
+    int count = static_cast<int>(lines.size());
+    if (count != static_cast<int>(m_lines.size())) {
+        m_firstChanged = std::min(m_firstChanged, std::min(count, static_cast<int>(m_lines.size())));
+        m_lines.resize(lines.size());
+    }
+    for (int i = 0; i < count; ++i) {
+        if (m_lines[i].text != lines[i]) {
+            buildLine(i, lines[i]);
+            m_firstChanged = std::min(m_firstChanged, i);
+            ++m_rebuilt;
+        }
+    }
+}
+
+//stb_easy_font quads are 4 corners of x, y, z and a colour, only x and y are kept
+void DebugOverlay::buildLine(int index, const std::string& text) {
+    Line& line = m_lines[index];
+    line.text = text;
+    line.vertices.clear();
+    m_glyphs.resize(text.size() * 400 + 64);//stb_easy_font takes about 270 bytes per character, it stops at the end
+    int quads = stb_easy_font_print(LEFT, TOP + index * LINE_HEIGHT, const_cast<char*>(text.c_str()), nullptr,
+        m_glyphs.data(), static_cast<int>(m_glyphs.size()));
+    const float* corners = reinterpret_cast<const float*>(m_glyphs.data());
+    line.vertices.reserve(static_cast<size_t>(quads) * 8);
+    for (int i = 0; i < quads * 4; ++i) {
+        line.vertices.push_back(corners[i * 4 + 0]);
+        line.vertices.push_back(corners[i * 4 + 1]);
+    }
+}
+
+//----------------- Draw -----------------
+void DebugOverlay::draw(int width, int height) {
+    m_lastFrame = Stats();
+    m_lastFrame.lines = static_cast<int>(m_lines.size());
+    m_lastFrame.rebuiltLines = m_rebuilt;
+    m_rebuilt = 0;
+
+    GLState::bindVertexArray(m_vao);
+    if (m_firstChanged <= static_cast<int>(m_lines.size())) {
+        //Lines ahead of the first changed one keep their place in the buffer
+        size_t kept = 0;
+        for (int i = 0; i < m_firstChanged; ++i) {
+            kept += m_lines[i].vertices.size();
+        }
+        m_vertices.resize(kept);
+        for (size_t i = m_firstChanged; i < m_lines.size(); ++i) {
+            m_vertices.insert(m_vertices.end(), m_lines[i].vertices.begin(), m_lines[i].vertices.end());
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        size_t bytes = m_vertices.size() * sizeof(float);
+        if (bytes > m_vboBytes) {
+            m_vboBytes = std::max(2 * bytes, static_cast<size_t>(64 * 1024));
+            glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(m_vboBytes), nullptr, GL_DYNAMIC_DRAW);
+            kept = 0;
+        }
+        if (bytes > kept * sizeof(float)) {
+            glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(kept * sizeof(float)), static_cast<GLsizeiptr>(bytes - kept * sizeof(float)),
+                m_vertices.data() + kept);
+            m_lastFrame.uploadedBytes = bytes - kept * sizeof(float);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    m_firstChanged = std::numeric_limits<int>::max();
+
+    int quads = static_cast<int>(m_vertices.size() / 8);
+    m_lastFrame.quads = quads;
+    if (quads == 0) return;
+
+    //Two triangles per quad, the same pattern for every frame
+    if (quads > m_indexedQuads) {
+        m_indexedQuads = std::max(quads, 2 * m_indexedQuads);
+        std::vector<GLuint> indices(static_cast<size_t>(m_indexedQuads) * 6);
+        for (int i = 0; i < m_indexedQuads; ++i) {
+            GLuint corner = static_cast<GLuint>(i) * 4;
+            GLuint quad[6] = { corner, corner + 1, corner + 2, corner, corner + 2, corner + 3 };
+            std::copy(quad, quad + 6, indices.begin() + static_cast<size_t>(i) * 6);
+        }
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(GLuint)), indices.data(), GL_STATIC_DRAW);
+    }
+
+    m_shader.use();
+    m_shader.set("uOrtho", glm::ortho(0.0f, float(width), float(height), 0.0f));
+    m_shader.set("uColor", glm::vec3(1.0f, 1.0f, 0.0f));
+    glDrawElements(GL_TRIANGLES, quads * 6, GL_UNSIGNED_INT, 0);
+}
@@ -0,0 +1,249 @@
+/*
+	Deflection lookup table
+	CPU twin of shaders/deflectionLut.comp, one integrated orbit per angle from the camera-to-hole axis,
+	or one resampled from the lensing atlas
+*/
+
+#include "../headers/deflectionLut.hpp"
+#include "../headers/lensingAtlas.hpp"
+#include <cmath>
+#include <algorithm>
+
+static const float PI = 3.14159265f;
+static const int MAX_SUBSTEPS = 16384;//Per row, only reached by rays skimming the photon sphere
+
+//----------------- Frustum -----------------
+//The angle to a fixed direction has no maximum inside a spherical rectangle narrower than a hemisphere
+//away from it, so the frustum corners bound every pixel
+float DeflectionLut::maxAngle(const glm::mat4& invView, const glm::mat4& invProj, const glm::vec3& camPos, const glm::vec3& bhPosition) {
+    glm::vec3 toHole = glm::normalize(bhPosition - camPos);
+    float widest = 0.0f;
+    for (int corner = 0; corner < 4; ++corner) {
+        glm::vec4 eye = invProj * glm::vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, -1.0f, 1.0f);
+        glm::vec3 dir = glm::normalize(glm::vec3(invView * glm::vec4(eye.x, eye.y, -1.0f, 0.0f)));
+        float angle = std::acos(glm::clamp(glm::dot(dir, toHole), -1.0f, 1.0f));
+        if (angle > 0.5f * PI) return PI;
+        widest = std::max(widest, angle);
+    }
+    return std::min(widest * 1.01f + 1e-3f, PI);
+}
+
+//----------------- Orbit -----------------
+//w' = u'' of the orbit, Binet: u'' + u = 1.5 rs u^2, rk4Step force law: u'' + u = rs (u^2 + w^2)
+static float orbitAccel(float u, float w, float rs, bool binet) {
+    return binet ? -u + 1.5f * rs * u * u : -u + rs * (u * u + w * w);
+}
+
+void DeflectionLut::orbitStep(float& u, float& w, float dphi, float rs, bool binet) {
+    float k1u = w, k1w = orbitAccel(u, w, rs, binet);
+    float k2u = w + 0.5f * dphi * k1w, k2w = orbitAccel(u + 0.5f * dphi * k1u, k2u, rs, binet);
+    float k3u = w + 0.5f * dphi * k2w, k3w = orbitAccel(u + 0.5f * dphi * k2u, k3u, rs, binet);
+    float k4u = w + dphi * k3w, k4w = orbitAccel(u + dphi * k3u, k4u, rs, binet);
+    u += dphi / 6.0f * (k1u + 2.0f * k2u + 2.0f * k3u + k4u);
+    w += dphi / 6.0f * (k1w + 2.0f * k2w + 2.0f * k3w + k4w);
+}
+
+//Radial, straight into the hole or straight out
+static void fillRadial(float u0, float cosAlpha, DeflectionLut::Row& row, glm::vec2* samples) {
+    row.phiEnd = 0.0f;
+    row.captured = cosAlpha > 0.0f ? 1.0f : 0.0f;
+    row.rMin = cosAlpha > 0.0f ? 0.0f : 1.0f / u0;
+    row._pad = 0.0f;
+    for (int i = 0; i < DeflectionLut::SAMPLES; ++i) samples[i] = glm::vec2(u0, 0.0f);
+}
+
+//Same control flow as main() in deflectionLut.comp
+static void integrateRow(float rs, float u0, float alpha, bool binet, DeflectionLut::Row& row, glm::vec2* samples) {
+    using namespace DeflectionLut;
+    float sinAlpha = std::sin(alpha), cosAlpha = std::cos(alpha);
+    row.phiEnd = 0.0f;
+    row.rMin = 1.0f / u0;
+    row._pad = 0.0f;
+
+    if (sinAlpha < 1e-4f) {
+        fillRadial(u0, cosAlpha, row, samples);
+        return;
+    }
+
+    float u = u0, w = u0 * cosAlpha / sinAlpha, phi = 0.0f;
+    samples[0] = glm::vec2(u, w);
+    row.captured = 1.0f;//Unless it reaches infinity within MAX_PHI
+    int i = 1;
+    for (int substep = 0; i < SAMPLES && substep < MAX_SUBSTEPS; ++substep) {
+        //u may change by at most a tenth per substep
+        float target = DPHI * i;
+        float limit = 0.1f * std::max(u, u0) / std::max(std::fabs(w), 1e-6f);
+        bool reach = target - phi <= limit;
+        float dphi = reach ? target - phi : limit;
+
+        float uPrev = u;
+        DeflectionLut::orbitStep(u, w, dphi, rs, binet);
+        if (u <= 0.0f) {
+            row.phiEnd = phi + dphi * uPrev / (uPrev - u);
+            row.captured = 0.0f;
+            phi += dphi;
+            break;
+        }
+        phi = reach ? target : phi + dphi;
+        if (u >= 1.0f / rs) break;
+        row.rMin = std::min(row.rMin, 1.0f / u);
+        if (reach) samples[i++] = glm::vec2(u, w);
+    }
+    if (row.captured > 0.5f) row.phiEnd = phi;
+
+    //Past the end the orbit carries on as a straight line in (phi, u), which stays off the disk
+    for (; i < SAMPLES; ++i) {
+        samples[i] = glm::vec2(u + w * (DPHI * i - phi), w);
+    }
+}
+
+void DeflectionLut::build(float rs, float camRadius, float maxAngle, bool binet, Table& table) {
+    table.maxAngle = maxAngle;
+    table.rows.resize(ENTRIES);
+    table.samples.resize(static_cast<size_t>(ENTRIES) * SAMPLES);
+    for (int row = 0; row < ENTRIES; ++row) {
+        float alpha = maxAngle * row / (ENTRIES - 1);
+        integrateRow(rs, 1.0f / camRadius, alpha, binet, table.rows[row], &table.samples[static_cast<size_t>(row) * SAMPLES]);
+    }
+}
+
+//----------------- Atlas -----------------
+//Where a camera ray joins one atlas orbit, in rs units. Inbound rays follow the orbit forwards from
+//where its inbound leg reaches the camera, outbound rays run the inbound leg backwards out to infinity.
+//On scattered orbits u0 is the camera's depth relative to the ray's own closest approach, so a camera
+//next to the periapsis lands next to it on both neighbouring rows instead of past one of them
+struct AtlasLeg {
+    float psi0;
+    float sign;
+    float phiEnd;
+    float captured;
+    float rMin;//Also in rs
+};
+
+static AtlasLeg joinOrbit(const LensingAtlas::Orbit& orbit, const glm::vec2* samples, float u0, bool inbound) {
+    AtlasLeg leg;
+    leg.psi0 = LensingAtlas::inboundAngle(orbit, samples, u0);
+    if (inbound) {
+        leg.sign = 1.0f;
+        leg.captured = orbit.captured;
+        leg.phiEnd = orbit.psiEnd - leg.psi0;
+        if (orbit.captured > 0.5f) leg.phiEnd = std::min(leg.phiEnd, DeflectionLut::MAX_PHI);
+        leg.rMin = 1.0f / std::max(orbit.uPeri, u0);
+    }
+    else {
+        leg.sign = -1.0f;
+        leg.captured = 0.0f;
+        leg.phiEnd = leg.psi0;
+        leg.rMin = 1.0f / u0;
+    }
+    return leg;
+}
+
+//Same control flow as the uFromAtlas path of deflectionLut.comp
+static void resampleRow(const LensingAtlas& atlas, float rs, float u0, float alpha, bool binet, DeflectionLut::Row& row, glm::vec2* samples) {
+    using namespace DeflectionLut;
+    float sinAlpha = std::sin(alpha), cosAlpha = std::cos(alpha);
+    float atlasU0 = u0 * rs;
+    if (sinAlpha < 1e-4f) {
+        fillRadial(u0, cosAlpha, row, samples);
+        return;
+    }
+
+    //Invariant of the ray in rs units, b = 1 / sqrt(u^2 / sin^2 - u^3) or K = sin e^u / u
+    float c = binet ? 1.0f / std::sqrt(atlasU0 * atlasU0 / (sinAlpha * sinAlpha) - atlasU0 * atlasU0 * atlasU0)
+                    : sinAlpha * std::exp(atlasU0) / atlasU0;
+    float t = LensingAtlas::orbitRow(c, binet);
+    int row0 = std::min(static_cast<int>(t), LensingAtlas::ORBITS - 1);
+    int row1 = std::min(row0 + 1, LensingAtlas::ORBITS - 1);
+    float blend = t - row0;
+
+    const LensingAtlas::Orbit* orbits = atlas.orbits(binet);
+    const glm::vec2* orbitSamples0 = atlas.samples(binet) + static_cast<size_t>(row0) * LensingAtlas::SAMPLES;
+    const glm::vec2* orbitSamples1 = atlas.samples(binet) + static_cast<size_t>(row1) * LensingAtlas::SAMPLES;
+    float depth = c > LensingAtlas::criticalInvariant(binet) ? atlasU0 / LensingAtlas::periapsis(c, binet) : 0.0f;
+    AtlasLeg a = joinOrbit(orbits[row0], orbitSamples0, depth > 0.0f ? depth * orbits[row0].uPeri : atlasU0, cosAlpha > 0.0f);
+    AtlasLeg b = joinOrbit(orbits[row1], orbitSamples1, depth > 0.0f ? depth * orbits[row1].uPeri : atlasU0, cosAlpha > 0.0f);
+    //Rows either side of the shadow edge don't blend, the nearer one wins
+    if (a.captured != b.captured) {
+        if (blend >= 0.5f) {
+            a = b;
+            orbitSamples0 = orbitSamples1;
+        }
+        blend = 0.0f;
+    }
+
+    row.phiEnd = a.phiEnd + (b.phiEnd - a.phiEnd) * blend;
+    row.captured = a.captured;
+    row.rMin = (a.rMin + (b.rMin - a.rMin) * blend) * rs;
+    row._pad = 0.0f;
+    for (int i = 0; i < SAMPLES; ++i) {
+        glm::vec2 sa = LensingAtlas::sample(orbitSamples0, a.psi0 + a.sign * DPHI * i);
+        glm::vec2 sb = LensingAtlas::sample(orbitSamples1, b.psi0 + b.sign * DPHI * i);
+        samples[i] = glm::vec2(sa.x + (sb.x - sa.x) * blend, a.sign * (sa.y + (sb.y - sa.y) * blend)) / rs;
+    }
+}
+
+bool DeflectionLut::resample(const LensingAtlas& atlas, float rs, float camRadius, float maxAngle, bool binet, Table& table) {
+    if (!atlas.mapped() || camRadius < LensingAtlas::MIN_CAMERA_RADIUS * rs || camRadius > LensingAtlas::C_MAX * rs) return false;
+    table.maxAngle = maxAngle;
+    table.rows.resize(ENTRIES);
+    table.samples.resize(static_cast<size_t>(ENTRIES) * SAMPLES);
+    for (int row = 0; row < ENTRIES; ++row) {
+        float alpha = maxAngle * row / (ENTRIES - 1);
+        resampleRow(atlas, rs, 1.0f / camRadius, alpha, binet, table.rows[row], &table.samples[static_cast<size_t>(row) * SAMPLES]);
+    }
+    return true;
+}
+
+//----------------- Lookup -----------------
+glm::vec3 DeflectionLut::Lookup::asymptote() const {
+    return std::cos(phiEnd) * e1 + std::sin(phiEnd) * e2;
+}
+
+bool DeflectionLut::lookup(const Table& table, const glm::vec3& pos, const glm::vec3& dir, Lookup& result) {
+    float r0 = glm::length(pos);
+    result.e1 = pos / r0;
+    float mu = glm::dot(dir, result.e1);
+    glm::vec3 tangent = dir - mu * result.e1;
+    float sinAlpha = glm::length(tangent);
+    result.e2 = sinAlpha > 1e-6f ? tangent / sinAlpha
+        : glm::normalize(glm::cross(result.e1, std::fabs(result.e1.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+    result.alpha = std::acos(glm::clamp(-mu, -1.0f, 1.0f));
+    if (result.alpha > table.maxAngle || table.rows.empty()) return false;
+
+    float t = result.alpha / table.maxAngle * (ENTRIES - 1);
+    result.row0 = std::min(static_cast<int>(t), ENTRIES - 1);
+    result.row1 = std::min(result.row0 + 1, ENTRIES - 1);
+    result.blend = t - result.row0;
+    if (table.rows[result.row0].captured != table.rows[result.row1].captured) {
+        if (result.blend >= 0.5f) result.row0 = result.row1;
+        result.row1 = result.row0;
+        result.blend = 0.0f;
+    }
+
+    const Row& a = table.rows[result.row0];
+    const Row& b = table.rows[result.row1];
+    result.phiEnd = a.phiEnd + (b.phiEnd - a.phiEnd) * result.blend;
+    result.captured = a.captured > 0.5f;
+    result.rMin = a.rMin + (b.rMin - a.rMin) * result.blend;
+    return true;
+}
+
+static glm::vec2 rowSample(const DeflectionLut::Table& table, int row, float phi) {
+    using namespace DeflectionLut;
+    float k = phi / DPHI;
+    int j = glm::clamp(static_cast<int>(k), 0, SAMPLES - 2);
+    float s = k - j;
+    const glm::vec2& a = table.samples[static_cast<size_t>(row) * SAMPLES + j];
+    const glm::vec2& b = table.samples[static_cast<size_t>(row) * SAMPLES + j + 1];
+    float s2 = s * s, s3 = s2 * s;
+    float u = (2.0f * s3 - 3.0f * s2 + 1.0f) * a.x + (s3 - 2.0f * s2 + s) * DPHI * a.y
+            + (3.0f * s2 - 2.0f * s3) * b.x + (s3 - s2) * DPHI * b.y;
+    return glm::vec2(u, a.y + (b.y - a.y) * s);
+}
+
+glm::vec2 DeflectionLut::sample(const Table& table, const Lookup& ray, float phi) {
+    glm::vec2 a = rowSample(table, ray.row0, phi);
+    glm::vec2 b = rowSample(table, ray.row1, phi);
+    return a + (b - a) * ray.blend;
+}
@@ -0,0 +1,99 @@
+/*
+	Frame ring
+	Triple-buffered, persistently mapped upload buffer for the blocks the renderer rewrites every frame
+*/
+
+#include "../headers/frameRing.hpp"
+#include "../headers/glHelpers.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+static size_t alignUp(size_t bytes, size_t alignment) {
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+//----------------- Storage -----------------
+void FrameRing::allocate(size_t regionBytes) {
+    for (int i = 0; i < FRAMES; ++i) {
+        waitFence(i);
+    }
+    if (m_buffer != 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        GLState::deleteBuffer(m_buffer);
+    }
+
+    m_regionBytes = alignUp(regionBytes, m_alignment);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(FRAMES * m_regionBytes), nullptr, flags);
+    m_mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, static_cast<GLsizeiptr>(FRAMES * m_regionBytes), flags));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (!m_mapped) throw std::runtime_error("Failed to map the frame ring");
+}
+
+void FrameRing::waitFence(int region) {
+    if (!m_fences[region]) return;
+    //Already signalled in the steady state, anything else is the CPU running FRAMES frames ahead
+    if (glClientWaitSync(m_fences[region], 0, 0) == GL_TIMEOUT_EXPIRED) {
+        ++m_frame.fenceWaits;
+        while (glClientWaitSync(m_fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+        }
+    }
+    glDeleteSync(m_fences[region]);
+    m_fences[region] = nullptr;
+}
+
+FrameRing::~FrameRing() {
+    for (GLsync fence : m_fences) {
+        if (fence) glDeleteSync(fence);
+    }
+    if (m_buffer != 0) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glDeleteBuffers(1, &m_buffer);
+    }
+}
+
+//----------------- Frames -----------------
+void FrameRing::beginFrame(size_t bytes, int blocks) {
+    if (m_alignment == 0) {
+        GLint uniformAlignment = 256, storageAlignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+        m_alignment = static_cast<size_t>(std::max(std::max(uniformAlignment, storageAlignment), 16));
+    }
+
+    m_frame = Stats();
+    m_region = (m_region + 1) % FRAMES;
+    m_offset = 0;
+    //Every block is padded to the alignment, and empty ones still take 16 bytes
+    size_t needed = bytes + static_cast<size_t>(blocks) * m_alignment;
+    if (needed > m_regionBytes) {
+        //Headroom for a growing scene, so this doesn't happen again next frame
+        allocate(std::max(2 * needed, static_cast<size_t>(64 * 1024)));
+        ++m_frame.reallocations;
+    }
+    else {
+        waitFence(m_region);
+    }
+}
+
+void FrameRing::bind(GLenum target, GLuint index, const void* data, size_t bytes) {
+    size_t size = std::max(bytes, static_cast<size_t>(16));//A range can't be empty
+    if (m_offset + size > m_regionBytes) throw std::runtime_error("Frame ring overflow, beginFrame was told too few bytes");
+
+    size_t offset = m_region * m_regionBytes + m_offset;
+    if (bytes > 0) std::memcpy(m_mapped + offset, data, bytes);
+    GLState::bindBufferRange(target, index, m_buffer, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+    m_offset += alignUp(size, m_alignment);
+    m_frame.bytes = m_offset;
+    ++m_frame.blocks;
+}
+
+void FrameRing::endFrame() {
+    m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_lastFrame = m_frame;
+}
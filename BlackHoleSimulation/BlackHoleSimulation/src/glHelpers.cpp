@@ -1,11 +1,14 @@
 /*
-	Utility functions for loading and compiling OpenGL shaders.
+	Utility functions for loading and compiling OpenGL shaders, reflecting linked programs
+	and skipping redundant GL binds.
 */
 
 #include "../headers/glHelpers.hpp"
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstring>
+#include <iterator>
 
 // Utility: read file contents
 static std::string readFile(const std::string& path) {
@@ -56,8 +59,12 @@ GLuint GLHelpers::loadShaderProgram(const std::string& vertPath, const std::stri
 }
 
 //Load, compile, and link a compute shader
-GLuint GLHelpers::loadComputeShader(const std::string& compPath) {
+GLuint GLHelpers::loadComputeShader(const std::string& compPath, const std::string& defines) {
     std::string csrc = readFile(compPath);
+    if (!defines.empty()) {
+        size_t lineEnd = csrc.find('\n');
+        csrc.insert(lineEnd == std::string::npos ? csrc.size() : lineEnd + 1, defines);
+    }
     const char* csrcC = csrc.c_str();
 
     GLuint cs = glCreateShader(GL_COMPUTE_SHADER);
@@ -86,3 +93,273 @@ GLuint GLHelpers::loadComputeShader(const std::string& compPath) {
     glDeleteShader(cs);
     return prog;
 }
+
+//----------------- Shader Program -----------------
+ShaderProgram::ShaderProgram(GLuint program) : m_program(program) {
+    GLint count = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        char name[256];
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program, static_cast<GLuint>(i), sizeof(name), nullptr, &size, &type, name);
+        GLint location = glGetUniformLocation(program, name);
+        if (location < 0) continue;//Block members
+
+        //Start from the linked value, so a sampler set to its layout binding is never written
+        Uniform uniform = { location, type, size == 1, {} };
+        if (uniform.known) {
+            switch (type) {
+            case GL_FLOAT: case GL_FLOAT_VEC2: case GL_FLOAT_VEC3: case GL_FLOAT_VEC4: case GL_FLOAT_MAT4:
+                glGetUniformfv(program, location, uniform.value);
+                break;
+            case GL_UNSIGNED_INT:
+                glGetUniformuiv(program, location, reinterpret_cast<GLuint*>(uniform.value));
+                break;
+            default://int, bool, their vectors and samplers
+                glGetUniformiv(program, location, reinterpret_cast<GLint*>(uniform.value));
+                break;
+            }
+        }
+        m_uniforms[name] = uniform;
+    }
+
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        char name[256];
+        GLint binding;
+        glGetActiveUniformBlockName(program, static_cast<GLuint>(i), sizeof(name), nullptr, name);
+        glGetActiveUniformBlockiv(program, static_cast<GLuint>(i), GL_UNIFORM_BLOCK_BINDING, &binding);
+        m_blocks[name] = { static_cast<GLuint>(i), static_cast<GLuint>(binding) };
+    }
+}
+
+ShaderProgram::~ShaderProgram() {
+    if (m_program != 0) glDeleteProgram(m_program);
+}
+
+ShaderProgram::ShaderProgram(ShaderProgram&& other) noexcept
+    : m_program(other.m_program), m_uniforms(std::move(other.m_uniforms)), m_blocks(std::move(other.m_blocks)) {
+    other.m_program = 0;
+}
+
+ShaderProgram& ShaderProgram::operator=(ShaderProgram&& other) noexcept {
+    if (this != &other) {
+        if (m_program != 0) glDeleteProgram(m_program);
+        m_program = other.m_program;
+        m_uniforms = std::move(other.m_uniforms);
+        m_blocks = std::move(other.m_blocks);
+        other.m_program = 0;
+    }
+    return *this;
+}
+
+void ShaderProgram::use() const {
+    GLState::useProgram(m_program);
+}
+
+ShaderProgram::Uniform* ShaderProgram::changed(const std::string& name, const void* data, size_t bytes) {
+    auto found = m_uniforms.find(name);
+    if (found == m_uniforms.end()) return nullptr;
+    Uniform& uniform = found->second;
+    if (uniform.known && std::memcmp(uniform.value, data, bytes) == 0) {
+        GLState::countUniform(false);
+        return nullptr;
+    }
+    std::memcpy(uniform.value, data, bytes);
+    uniform.known = true;
+    GLState::countUniform(true);
+    return &uniform;
+}
+
+void ShaderProgram::set(const std::string& name, int value) {
+    if (Uniform* uniform = changed(name, &value, sizeof(value))) glProgramUniform1i(m_program, uniform->location, value);
+}
+
+void ShaderProgram::set(const std::string& name, GLuint value) {
+    if (Uniform* uniform = changed(name, &value, sizeof(value))) glProgramUniform1ui(m_program, uniform->location, value);
+}
+
+void ShaderProgram::set(const std::string& name, float value) {
+    if (Uniform* uniform = changed(name, &value, sizeof(value))) glProgramUniform1f(m_program, uniform->location, value);
+}
+
+void ShaderProgram::set(const std::string& name, const glm::vec2& value) {
+    if (Uniform* uniform = changed(name, &value.x, sizeof(value))) glProgramUniform2fv(m_program, uniform->location, 1, &value.x);
+}
+
+void ShaderProgram::set(const std::string& name, const glm::ivec2& value) {
+    if (Uniform* uniform = changed(name, &value.x, sizeof(value))) glProgramUniform2iv(m_program, uniform->location, 1, &value.x);
+}
+
+void ShaderProgram::set(const std::string& name, const glm::vec3& value) {
+    if (Uniform* uniform = changed(name, &value.x, sizeof(value))) glProgramUniform3fv(m_program, uniform->location, 1, &value.x);
+}
+
+void ShaderProgram::set(const std::string& name, const glm::mat4& value) {
+    if (Uniform* uniform = changed(name, &value[0][0], sizeof(value))) glProgramUniformMatrix4fv(m_program, uniform->location, 1, GL_FALSE, &value[0][0]);
+}
+
+void ShaderProgram::bindBlock(const std::string& name, GLuint binding) {
+    auto found = m_blocks.find(name);
+    if (found == m_blocks.end()) return;
+    if (found->second.second == binding) {
+        GLState::countUniform(false);
+        return;
+    }
+    glUniformBlockBinding(m_program, found->second.first, binding);
+    found->second.second = binding;
+    GLState::countUniform(true);
+}
+
+//----------------- GL State -----------------
+namespace {
+    const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    struct BufferBinding {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;//-1 for the whole buffer
+    };
+
+    struct ImageBinding {
+        GLuint texture;
+        GLint level;
+        GLenum access, format;
+    };
+
+    struct Shadow {
+        GLuint program = UNKNOWN, vao = UNKNOWN, framebuffer = UNKNOWN, activeUnit = UNKNOWN;
+        std::unordered_map<unsigned long long, GLuint> textures;//Unit and target
+        std::unordered_map<GLuint, ImageBinding> images;
+        std::unordered_map<unsigned long long, BufferBinding> buffers;//Target and index
+        GLState::Stats frame, lastFrame;
+    };
+
+    Shadow& shadow() {
+        static Shadow state;
+        return state;
+    }
+
+    unsigned long long key(GLuint a, GLuint b) {
+        return (static_cast<unsigned long long>(a) << 32) | b;
+    }
+
+    //True when the call has to be sent
+    bool update(GLuint& current, GLuint wanted) {
+        Shadow& state = shadow();
+        if (current == wanted) {
+            ++state.frame.skipped;
+            return false;
+        }
+        current = wanted;
+        ++state.frame.issued;
+        return true;
+    }
+
+    void bindBuffer(GLenum target, GLuint index, const BufferBinding& binding) {
+        Shadow& state = shadow();
+        auto found = state.buffers.find(key(target, index));
+        if (found != state.buffers.end() && found->second.buffer == binding.buffer
+            && found->second.offset == binding.offset && found->second.size == binding.size) {
+            ++state.frame.skipped;
+            return;
+        }
+        state.buffers[key(target, index)] = binding;
+        ++state.frame.issued;
+        if (binding.size < 0) glBindBufferBase(target, index, binding.buffer);
+        else glBindBufferRange(target, index, binding.buffer, binding.offset, binding.size);
+    }
+}
+
+void GLState::useProgram(GLuint program) {
+    if (update(shadow().program, program)) {
+        glUseProgram(program);
+        ++shadow().frame.programSwitches;
+    }
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+    if (update(shadow().vao, vao)) glBindVertexArray(vao);
+}
+
+void GLState::bindFramebuffer(GLuint framebuffer) {
+    if (update(shadow().framebuffer, framebuffer)) glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    Shadow& state = shadow();
+    auto found = state.textures.find(key(unit, target));
+    if (found != state.textures.end() && found->second == texture) {
+        ++state.frame.skipped;
+        return;
+    }
+    if (update(state.activeUnit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+    state.textures[key(unit, target)] = texture;
+    ++state.frame.issued;
+    glBindTexture(target, texture);
+}
+
+void GLState::bindImageTexture(GLuint unit, GLuint texture, GLint level, GLenum access, GLenum format) {
+    Shadow& state = shadow();
+    auto found = state.images.find(unit);
+    if (found != state.images.end() && found->second.texture == texture && found->second.level == level
+        && found->second.access == access && found->second.format == format) {
+        ++state.frame.skipped;
+        return;
+    }
+    state.images[unit] = { texture, level, access, format };
+    ++state.frame.issued;
+    glBindImageTexture(unit, texture, level, GL_FALSE, 0, access, format);
+}
+
+void GLState::bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+    bindBuffer(target, index, { buffer, 0, -1 });
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    bindBuffer(target, index, { buffer, offset, size });
+}
+
+//Forget every binding of a deleted object before glGen* hands its name out again
+void GLState::deleteTexture(GLuint texture) {
+    if (texture == 0) return;
+    Shadow& state = shadow();
+    for (auto it = state.textures.begin(); it != state.textures.end();) {
+        it = it->second == texture ? state.textures.erase(it) : std::next(it);
+    }
+    for (auto it = state.images.begin(); it != state.images.end();) {
+        it = it->second.texture == texture ? state.images.erase(it) : std::next(it);
+    }
+    glDeleteTextures(1, &texture);
+}
+
+void GLState::deleteBuffer(GLuint buffer) {
+    if (buffer == 0) return;
+    Shadow& state = shadow();
+    for (auto it = state.buffers.begin(); it != state.buffers.end();) {
+        it = it->second.buffer == buffer ? state.buffers.erase(it) : std::next(it);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+void GLState::countUniform(bool issued) {
+    ++(issued ? shadow().frame.issued : shadow().frame.skipped);
+}
+
+void GLState::invalidate() {
+    Shadow& state = shadow();
+    state.program = state.vao = state.framebuffer = state.activeUnit = UNKNOWN;
+    state.textures.clear();
+    state.images.clear();
+    state.buffers.clear();
+}
+
+void GLState::endFrame() {
+    shadow().lastFrame = shadow().frame;
+    shadow().frame = Stats();
+}
+
+const GLState::Stats& GLState::lastFrame() {
+    return shadow().lastFrame;
+}
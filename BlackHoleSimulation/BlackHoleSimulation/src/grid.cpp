@@ -35,7 +35,7 @@ static GLuint compileShader(GLenum type, const std::string& src) {
 }
 
 Grid3D::Grid3D(float min, float max, float spacing, float bhRadius)
-    : m_vao(0), m_vbo(0), m_vertexCount(0), m_shaderProgram(0)
+    : m_vao(0), m_vbo(0), m_vertexCount(0)
 {
     //More physical well
     //y = -wellDepth / r (Newtonian/Schwarzschild-like)
@@ -87,7 +87,6 @@ Grid3D::Grid3D(float min, float max, float spacing, float bhRadius)
 Grid3D::~Grid3D() {
     glDeleteVertexArrays(1, &m_vao);
     glDeleteBuffers(1, &m_vbo);
-    glDeleteProgram(m_shaderProgram);
 }
 
 //----------------- Init Shader -----------------
@@ -96,28 +95,28 @@ void Grid3D::initShader() {
     std::string fragSrc = loadFile("shaders/grid/shader.frag");
     GLuint vert = compileShader(GL_VERTEX_SHADER, vertSrc);
     GLuint frag = compileShader(GL_FRAGMENT_SHADER, fragSrc);
-    m_shaderProgram = glCreateProgram();
-    glAttachShader(m_shaderProgram, vert);
-    glAttachShader(m_shaderProgram, frag);
-    glLinkProgram(m_shaderProgram);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vert);
+    glAttachShader(program, frag);
+    glLinkProgram(program);
     int success;
-    glGetProgramiv(m_shaderProgram, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
         char info[512];
-        glGetProgramInfoLog(m_shaderProgram, 512, nullptr, info);
+        glGetProgramInfoLog(program, 512, nullptr, info);
         throw std::runtime_error("Shader linking error: " + std::string(info));
     }
     glDeleteShader(vert);
     glDeleteShader(frag);
+    m_shaderProgram = ShaderProgram(program);
 }
 
 //----------------- Draw -----------------
 void Grid3D::draw(const glm::mat4& view, const glm::mat4& proj) {
-    glUseProgram(m_shaderProgram);
-    glUniform3f(glGetUniformLocation(m_shaderProgram, "uGridColor"), 0.0f, 0.0f, 0.0f);
-    glUniformMatrix4fv(glGetUniformLocation(m_shaderProgram, "uView"), 1, GL_FALSE, &view[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(m_shaderProgram, "uProj"), 1, GL_FALSE, &proj[0][0]);
-    glBindVertexArray(m_vao);
+    m_shaderProgram.use();
+    m_shaderProgram.set("uGridColor", glm::vec3(0.0f));
+    m_shaderProgram.set("uView", view);
+    m_shaderProgram.set("uProj", proj);
+    GLState::bindVertexArray(m_vao);
     glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(m_vertexCount));
-    glBindVertexArray(0);
 }
\ No newline at end of file
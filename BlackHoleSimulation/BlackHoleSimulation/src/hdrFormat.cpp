@@ -0,0 +1,31 @@
+/*
+	HDR formats
+	Render target formats the renderer can allocate its HDR image and bloom chain in
+*/
+
+#include "../headers/hdrFormat.hpp"
+#include <cstring>
+
+static const HdrFormats::Info FORMATS[HdrFormats::COUNT] = {
+    { "rgba32f", GL_RGBA32F, "rgba32f", 16 },
+    { "rgba16f", GL_RGBA16F, "rgba16f", 8 },
+    { "r11g11b10f", GL_R11F_G11F_B10F, "r11f_g11f_b10f", 4 },//6 and 5 bit mantissas, no sign
+};
+
+const HdrFormats::Info& HdrFormats::info(HdrFormat format) {
+    return FORMATS[static_cast<int>(format)];
+}
+
+bool HdrFormats::parse(const char* name, HdrFormat& format) {
+    for (int i = 0; i < COUNT; ++i) {
+        if (std::strcmp(name, FORMATS[i].name) == 0) {
+            format = static_cast<HdrFormat>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+HdrFormat HdrFormats::bloomFormat(HdrFormat format) {
+    return format == HdrFormat::RGBA32F ? HdrFormat::RGBA16F : format;
+}
@@ -0,0 +1,173 @@
+/*
+	Headless context
+	Offscreen GL context and framebuffer, surfaceless EGL on Linux and an invisible GLFW window elsewhere
+*/
+
+#include "../headers/headless.hpp"
+#include "../headers/glHelpers.hpp"
+#include <stdexcept>
+#include <string>
+#include <cstring>
+
+#ifdef _WIN32
+#include <GLFW/glfw3.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+//----------------- Context -----------------
+#ifdef _WIN32
+static void createContext(int width, int height, void*&, void*&, GLFWwindow*& window) {
+    if (!glfwInit()) {
+        throw std::runtime_error("Failed to initialize GLFW!");
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    window = glfwCreateWindow(width, height, "Black Hole Simulation", nullptr, nullptr);
+    if (!window) {
+        glfwTerminate();
+        throw std::runtime_error("Failed to create a hidden GLFW window!");
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        throw std::runtime_error("Failed to initialize GLAD!");
+    }
+}
+
+static void destroyContext(void*, void*, GLFWwindow* window) {
+    if (window) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+}
+#else
+static bool hasExtension(const char* extensions, const char* name) {
+    if (!extensions) return false;
+    size_t length = std::strlen(name);
+    for (const char* found = std::strstr(extensions, name); found; found = std::strstr(found + length, name)) {
+        bool starts = found == extensions || found[-1] == ' ';
+        bool ends = found[length] == ' ' || found[length] == '\0';
+        if (starts && ends) return true;
+    }
+    return false;
+}
+
+//Mesa's surfaceless platform needs no display server at all, the default display is the fallback for drivers without it
+static void createContext(int, int, void*& display, void*& context, GLFWwindow*&) {
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY) eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        throw std::runtime_error("Failed to initialize EGL!");
+    }
+    display = eglDisplay;
+
+    const char* extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+    if (!hasExtension(extensions, "EGL_KHR_surfaceless_context")) {
+        throw std::runtime_error("EGL display can't make a context current without a surface");
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        throw std::runtime_error("EGL display has no desktop OpenGL");
+    }
+
+    //No config needed when nothing is ever drawn to an EGL surface
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!hasExtension(extensions, "EGL_KHR_no_config_context")) {
+        const EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLint configs = 0;
+        if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configs) || configs == 0) {
+            throw std::runtime_error("No EGL config for desktop OpenGL");
+        }
+    }
+
+    //Core OpenGL 4.5, as the window asks for
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+    if (eglContext == EGL_NO_CONTEXT) {
+        throw std::runtime_error("Failed to create an OpenGL 4.5 core EGL context!");
+    }
+    context = eglContext;
+    if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        throw std::runtime_error("Failed to make the EGL context current!");
+    }
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        throw std::runtime_error("Failed to initialize GLAD!");
+    }
+}
+
+static void destroyContext(void* display, void* context, GLFWwindow*) {
+    if (!display) return;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context) eglDestroyContext(display, context);
+    eglTerminate(display);
+}
+#endif
+
+HeadlessContext::HeadlessContext(int width, int height)
+    : m_width(width), m_height(height)
+{
+    try {
+        createContext(width, height, m_display, m_context, m_window);
+    }
+    catch (...) {
+        destroyContext(m_display, m_context, m_window);
+        throw;
+    }
+
+    glGenRenderbuffers(2, m_renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_renderbuffers[1]);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteRenderbuffers(2, m_renderbuffers);
+        destroyContext(m_display, m_context, m_window);
+        throw std::runtime_error("Headless framebuffer incomplete: " + std::to_string(status));
+    }
+}
+
+HeadlessContext::~HeadlessContext() {
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteRenderbuffers(2, m_renderbuffers);
+    destroyContext(m_display, m_context, m_window);
+}
+
+//----------------- Readback -----------------
+void HeadlessContext::readPixels(std::vector<float>& rgba) const {
+    rgba.resize(static_cast<size_t>(m_width) * m_height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_FLOAT, rgba.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    GLState::invalidate();
+}
+
+const char* HeadlessContext::backend() const {
+#ifdef _WIN32
+    return "hidden GLFW window";
+#else
+    return "surfaceless EGL";
+#endif
+}
@@ -0,0 +1,306 @@
+/*
+	Lensing atlas
+	Offline builder for the orbit families and the read-only mapping the renderer and CPU tracer sample
+*/
+
+#include "../headers/lensingAtlas.hpp"
+#include "../headers/deflectionLut.hpp"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+constexpr uint32_t LensingAtlas::VERSION;
+constexpr int LensingAtlas::ORBITS;
+constexpr int LensingAtlas::PLUNGE_ORBITS;
+constexpr int LensingAtlas::SAMPLES;
+constexpr float LensingAtlas::DPSI;
+constexpr float LensingAtlas::PSI_MAX;
+constexpr float LensingAtlas::C_MAX;
+constexpr float LensingAtlas::MIN_CAMERA_RADIUS;
+
+static const int MAX_SUBSTEPS = 65536;//Per orbit, only reached by orbits skimming the photon sphere
+static const float NEAR_CRITICAL = 1e-6f;//Closest row to the critical invariant, relative
+static const float NEAR_RADIAL = 0.999f;//Narrowest plunging row, relative distance below critical
+
+//Fixed size header, the tables follow in native byte order
+struct AtlasHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t orbits;
+    uint32_t plungeOrbits;
+    uint32_t samples;
+    float dpsi;
+    float cMax;
+    uint32_t _pad;
+};
+
+static const char MAGIC[4] = { 'B', 'H', 'L', 'A' };
+
+static AtlasHeader currentHeader() {
+    AtlasHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = LensingAtlas::VERSION;
+    header.orbits = LensingAtlas::ORBITS;
+    header.plungeOrbits = LensingAtlas::PLUNGE_ORBITS;
+    header.samples = LensingAtlas::SAMPLES;
+    header.dpsi = LensingAtlas::DPSI;
+    header.cMax = LensingAtlas::C_MAX;
+    header._pad = 0;
+    return header;
+}
+
+//----------------- Rows -----------------
+float LensingAtlas::criticalInvariant(bool binet) {
+    //Binet: b = 1.5 sqrt(3) rs at the photon sphere, rk4Step law: min of e^(rs u) / u is e rs at u = 1 / rs
+    return binet ? 2.5980762f : 2.7182818f;
+}
+
+float LensingAtlas::orbitInvariant(int row, bool binet) {
+    float critical = criticalInvariant(binet);
+    if (row < PLUNGE_ORBITS) {
+        float t = static_cast<float>(row) / (PLUNGE_ORBITS - 1);
+        float logGap = std::log(NEAR_RADIAL) + (std::log(NEAR_CRITICAL) - std::log(NEAR_RADIAL)) * t;
+        return critical * (1.0f - std::exp(logGap));
+    }
+    float t = static_cast<float>(row - PLUNGE_ORBITS) / (ORBITS - PLUNGE_ORBITS - 1);
+    float logGap = std::log(NEAR_CRITICAL) + (std::log(C_MAX / critical - 1.0f) - std::log(NEAR_CRITICAL)) * t;
+    return critical * (1.0f + std::exp(logGap));
+}
+
+float LensingAtlas::orbitRow(float c, bool binet) {
+    float critical = criticalInvariant(binet);
+    if (c < critical) {
+        float gap = std::max(1.0f - c / critical, NEAR_CRITICAL);
+        float t = (std::log(gap) - std::log(NEAR_RADIAL)) / (std::log(NEAR_CRITICAL) - std::log(NEAR_RADIAL));
+        return std::min(std::max(t, 0.0f), 1.0f) * (PLUNGE_ORBITS - 1);
+    }
+    float gap = std::max(c / critical - 1.0f, NEAR_CRITICAL);
+    float t = (std::log(gap) - std::log(NEAR_CRITICAL)) / (std::log(C_MAX / critical - 1.0f) - std::log(NEAR_CRITICAL));
+    return PLUNGE_ORBITS + std::min(std::max(t, 0.0f), 1.0f) * (ORBITS - PLUNGE_ORBITS - 1);
+}
+
+float LensingAtlas::periapsis(float c, bool binet) {
+    //Binet: w^2 = 1/c^2 - u^2 + u^3, rk4Step law: w^2 = e^(2u)/c^2 - u^2, both rise monotonically to the
+    //critical radius so bisect up to it
+    float lo = 0.0f, hi = binet ? 2.0f / 3.0f : 1.0f;
+    for (int i = 0; i < 24; ++i) {
+        float u = 0.5f * (lo + hi);
+        float turning = binet ? u * u - u * u * u - 1.0f / (c * c) : u * std::exp(-u) - 1.0f / c;
+        if (turning < 0.0f) lo = u;
+        else hi = u;
+    }
+    return 0.5f * (lo + hi);
+}
+
+//----------------- Sampling -----------------
+glm::vec2 LensingAtlas::sample(const glm::vec2* orbit, float psi) {
+    //Before the first and past the last sample the orbit carries on as a straight line in (psi, u)
+    if (psi <= 0.0f) return glm::vec2(orbit[0].x + orbit[0].y * psi, orbit[0].y);
+    float k = psi / DPSI;
+    if (k >= SAMPLES - 1) {
+        const glm::vec2& last = orbit[SAMPLES - 1];
+        return glm::vec2(last.x + last.y * (psi - DPSI * (SAMPLES - 1)), last.y);
+    }
+    int j = static_cast<int>(k);
+    float s = k - j;
+    const glm::vec2& a = orbit[j];
+    const glm::vec2& b = orbit[j + 1];
+    float s2 = s * s, s3 = s2 * s;
+    float u = (2.0f * s3 - 3.0f * s2 + 1.0f) * a.x + (s3 - 2.0f * s2 + s) * DPSI * a.y
+            + (3.0f * s2 - 2.0f * s3) * b.x + (s3 - s2) * DPSI * b.y;
+    return glm::vec2(u, a.y + (b.y - a.y) * s);
+}
+
+float LensingAtlas::inboundAngle(const Orbit& orbit, const glm::vec2* samples, float u) {
+    //u rises monotonically up to the closest approach, bisect the samples then solve the Hermite segment
+    int top = std::min(static_cast<int>(orbit.psiPeri / DPSI), SAMPLES - 1);
+    if (top >= SAMPLES - 1 && samples[SAMPLES - 1].x <= u) return PSI_MAX;
+    int lo = 0, hi = top;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (samples[mid].x <= u) lo = mid;
+        else hi = mid - 1;
+    }
+    if (lo >= SAMPLES - 1) return std::min(orbit.psiPeri, PSI_MAX);
+
+    const glm::vec2& a = samples[lo];
+    const glm::vec2& b = samples[lo + 1];
+    float s = b.x > a.x ? glm::clamp((u - a.x) / (b.x - a.x), 0.0f, 1.0f) : 0.5f;
+    for (int i = 0; i < 4; ++i) {
+        float s2 = s * s, s3 = s2 * s;
+        float h = (2.0f * s3 - 3.0f * s2 + 1.0f) * a.x + (s3 - 2.0f * s2 + s) * DPSI * a.y
+                + (3.0f * s2 - 2.0f * s3) * b.x + (s3 - s2) * DPSI * b.y;
+        float dh = (6.0f * s2 - 6.0f * s) * a.x + (3.0f * s2 - 4.0f * s + 1.0f) * DPSI * a.y
+                 + (6.0f * s - 6.0f * s2) * b.x + (3.0f * s2 - 2.0f * s) * DPSI * b.y;
+        if (dh <= 0.0f) break;
+        s = glm::clamp(s - (h - u) / dh, 0.0f, 1.0f);
+    }
+    return std::min(DPSI * (lo + s), orbit.psiPeri);
+}
+
+//----------------- Builder -----------------
+//Orbit from the incoming asymptote: u = 0 and w = 1 / c there for both force laws, rs = 1
+static void integrateOrbit(float c, bool binet, LensingAtlas::Orbit& orbit, glm::vec2* samples) {
+    using A = LensingAtlas;
+    orbit.c = c;
+    orbit.psiEnd = A::PSI_MAX;
+    orbit.psiPeri = A::PSI_MAX;
+    orbit.uPeri = 0.0f;
+    orbit.captured = 1.0f;//Unless it reaches infinity or the horizon within PSI_MAX
+    orbit._pad[0] = orbit._pad[1] = orbit._pad[2] = 0.0f;
+
+    float u = 0.0f, w = 1.0f / c, psi = 0.0f;
+    float uRef = 0.05f * std::min(1.0f / c, 1.0f);//Scale for the step limit while u is still ~0
+    bool escaped = false, horizon = false;
+    samples[0] = glm::vec2(u, w);
+    int i = 1;
+    for (int substep = 0; i < A::SAMPLES && substep < MAX_SUBSTEPS; ++substep) {
+        //u may change by at most a tenth per substep
+        float target = A::DPSI * i;
+        float limit = 0.1f * std::max(u, uRef) / std::max(std::fabs(w), 1e-6f);
+        bool reach = target - psi <= limit;
+        float dpsi = reach ? target - psi : limit;
+
+        float uPrev = u, wPrev = w;
+        DeflectionLut::orbitStep(u, w, dpsi, 1.0f, binet);
+        if (u <= 0.0f && w < 0.0f) {
+            orbit.psiEnd = psi + dpsi * uPrev / (uPrev - u);
+            escaped = true;
+            psi += dpsi;
+            break;
+        }
+        if (wPrev > 0.0f && w <= 0.0f && orbit.psiPeri >= A::PSI_MAX) {
+            orbit.psiPeri = psi + dpsi * wPrev / (wPrev - w);
+        }
+        if (u >= 1.0f) {
+            orbit.psiEnd = psi + dpsi * (1.0f - uPrev) / (u - uPrev);
+            horizon = true;
+            psi += dpsi;
+            break;
+        }
+        psi = reach ? target : psi + dpsi;
+        orbit.uPeri = std::max(orbit.uPeri, u);
+        if (reach) samples[i++] = glm::vec2(u, w);
+    }
+
+    //Past the end the orbit carries on as a straight line in (psi, u), as in the deflection table
+    for (; i < A::SAMPLES; ++i) {
+        samples[i] = glm::vec2(u + w * (A::DPSI * i - psi), w);
+    }
+
+    if (escaped) {
+        //Symmetric about the closest approach
+        orbit.captured = 0.0f;
+        orbit.psiPeri = 0.5f * orbit.psiEnd;
+        orbit.uPeri = LensingAtlas::sample(samples, orbit.psiPeri).x;
+    }
+    else if (horizon) {
+        orbit.psiPeri = orbit.psiEnd;
+        orbit.uPeri = 1.0f;
+    }
+}
+
+bool LensingAtlas::build(const std::string& path) {
+    std::vector<Orbit> orbits(2 * ORBITS);
+    std::vector<glm::vec2> samples(static_cast<size_t>(2) * ORBITS * SAMPLES);
+    for (int law = 0; law < 2; ++law) {
+        for (int row = 0; row < ORBITS; ++row) {
+            size_t index = static_cast<size_t>(law) * ORBITS + row;
+            integrateOrbit(orbitInvariant(row, law == 1), law == 1, orbits[index], &samples[index * SAMPLES]);
+        }
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    AtlasHeader header = currentHeader();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(orbits.data()), orbitBytes());
+    file.write(reinterpret_cast<const char*>(samples.data()), sampleBytes());
+    return file.good();
+}
+
+//----------------- Mapping -----------------
+LensingAtlas::~LensingAtlas() {
+    unmap();
+}
+
+bool LensingAtlas::map(const std::string& path) {
+    unmap();
+    size_t expected = sizeof(AtlasHeader) + orbitBytes() + sampleBytes();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    m_file = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || static_cast<size_t>(size.QuadPart) != expected) {
+        unmap();
+        return false;
+    }
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        unmap();
+        return false;
+    }
+    m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    m_file = open(path.c_str(), O_RDONLY);
+    if (m_file < 0) return false;
+    struct stat info;
+    if (fstat(m_file, &info) != 0 || static_cast<size_t>(info.st_size) != expected) {
+        unmap();
+        return false;
+    }
+    void* data = mmap(nullptr, expected, PROT_READ, MAP_SHARED, m_file, 0);
+    m_data = data == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(data);
+#endif
+    if (!m_data) {
+        unmap();
+        return false;
+    }
+    m_size = expected;
+
+    AtlasHeader header = currentHeader();
+    if (std::memcmp(m_data, &header, sizeof(header)) != 0) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+void LensingAtlas::unmap() {
+#ifdef _WIN32
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file) CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if (m_data) munmap(const_cast<unsigned char*>(m_data), m_size);
+    if (m_file >= 0) close(m_file);
+    m_file = -1;
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+const LensingAtlas::Orbit* LensingAtlas::orbits() const {
+    return reinterpret_cast<const Orbit*>(m_data + sizeof(AtlasHeader));
+}
+
+const glm::vec2* LensingAtlas::samples() const {
+    return reinterpret_cast<const glm::vec2*>(m_data + sizeof(AtlasHeader) + orbitBytes());
+}
@@ -1,12 +1,32 @@
 /*
     Entry point for the Black Hole Simulation application
+    --cpu renders one frame headless with the CPU tracer, --cpu-bench measures its thread scaling
+    --packet-bench compares the SIMD ray packet kernel against the scalar port
+    --accuracy reports each integrator mode's error against the double precision reference
+    --build-atlas writes the lensing atlas the renderer maps at startup
+    --headless renders --frames N frames with the GPU renderer without a window or display
+    --hdr-report prints the memory and traffic of each --hdr-format at --size
+    Otherwise opens the window, --hdr-format picks its render target format
 */
 
 #include "../headers/app.hpp"
 #include "../headers/renderer.hpp"
+#include "../headers/offline.hpp"
+#include <cstring>
 
-int main() {
-    App app(1280, 720, "Black Hole Simulation");
+int main(int argc, char** argv) {
+    Offline::Options options = Offline::parseOptions(argc, argv);
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--cpu") == 0) return Offline::renderCpu(options);
+        if (std::strcmp(argv[i], "--cpu-bench") == 0) return Offline::benchmarkCpu(options);
+        if (std::strcmp(argv[i], "--packet-bench") == 0) return Offline::benchmarkPacket(options);
+        if (std::strcmp(argv[i], "--accuracy") == 0) return Offline::accuracyReport(options);
+        if (std::strcmp(argv[i], "--build-atlas") == 0) return Offline::buildAtlas(options);
+        if (std::strcmp(argv[i], "--headless") == 0) return Offline::renderHeadless(options);
+        if (std::strcmp(argv[i], "--hdr-report") == 0) return Offline::hdrReport(options);
+    }
+
+    App app(1280, 720, "Black Hole Simulation", options.hdrFormat);
     app.run();
     return 0;
 }
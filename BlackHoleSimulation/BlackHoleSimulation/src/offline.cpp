@@ -0,0 +1,484 @@
+/*
+	Headless entry points
+	Builds the default scene on the CPU and drives the CPU tracer from the command line, or the GPU renderer offscreen
+*/
+
+#include "../headers/offline.hpp"
+#include "../headers/physics.hpp"
+#include "../headers/camera.hpp"
+#include "../headers/accuracy.hpp"
+#include "../headers/lensingAtlas.hpp"
+#include "../headers/headless.hpp"
+#include "../headers/renderer.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+//----------------- Scene -----------------
+//Same black hole, disk and planets as the Renderer constructor, plus beltBodies of its debris belt at time 0
+static void buildDefaultScene(const Camera& camera, SceneAssets& assets, TraceScene& scene, int beltBodies) {
+    if (!assets.smoke.load("textures/smoke/smoke_01.png")) {
+        std::cerr << "Failed to load smoke texture!" << std::endl;
+    }
+    assets.smoke.repeat = false;
+
+    //Cubemap face order: +X, -X, +Y, -Y, +Z, -Z
+    std::vector<std::string> faces = {
+        "textures/skybox/right.png",
+        "textures/skybox/left.png",
+        "textures/skybox/top.png",
+        "textures/skybox/bottom.png",
+        "textures/skybox/front.png",
+        "textures/skybox/back.png"
+    };
+    if (!assets.skybox.load(faces)) {
+        std::cerr << "Failed to load skybox textures!" << std::endl;
+    }
+
+    const double scale = 0.0001016;
+    float bhRadiusSim = static_cast<float>(Physics::schwarzschildRadius(5.0 * Physics::solarMass) * scale);
+
+    CameraUBO cam = camera.getUBO();
+    scene.invView = cam.invView;
+    scene.invProj = cam.invProj;
+    scene.camPos = glm::vec3(cam.position);
+    scene.bhPosition = glm::vec3(0.0f);
+    scene.bhRadius = bhRadiusSim;
+    scene.diskInnerRadius = bhRadiusSim * 3.0f;
+    scene.diskOuterRadius = bhRadiusSim * 10.0f;
+    scene.diskColor = glm::vec3(1.0f, 0.7f, 0.2f);
+    scene.time = 0.0f;
+
+    assets.planetTextures.resize(2);
+    assets.planetTextures[0].load("textures/planets/earthTexture.jpg");
+    assets.planetTextures[1].load("textures/planets/marsTexture.jpg");
+    scene.planets.push_back({ glm::vec3(0.0f, 0.0f, -90.0f), 6378.0f * static_cast<float>(scale), glm::vec3(1.0f), 0 });
+    scene.planets.push_back({ glm::vec3(-15.0f, 0.0f, -90.0f), 3389.5f * static_cast<float>(scale), glm::vec3(1.0f, 0.5f, 0.3f), 1 });
+    for (const BeltBody& body : Physics::debrisBelt(beltBodies, bhRadiusSim)) {
+        scene.planets.push_back({ body.position(body.orbitPhase), body.radius, body.color, -1 });
+    }
+
+    scene.assets = &assets;
+}
+
+//Write a bottom-up RGBA float buffer as a top-down binary PPM
+static bool writePPM(const std::string& path, int width, int height, const std::vector<float>& rgba) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<unsigned char> row(static_cast<size_t>(width) * 3);
+    for (int y = height - 1; y >= 0; --y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                float v = rgba[(static_cast<size_t>(y) * width + x) * 4 + c];
+                row[x * 3 + c] = static_cast<unsigned char>(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+            }
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    return true;
+}
+
+static void printStats(const TraceStats& stats) {
+    std::cout << stats.threads << " threads: " << stats.seconds * 1000.0 << " ms, "
+        << stats.raysPerSecond() / 1e6 << " Mrays/s, "
+        << stats.stepsPerSecond() / 1e6 << " Msteps/s, "
+        << (stats.rays ? 100.0 * stats.tableRays / stats.rays : 0.0) << "% from the deflection table, "
+        << (stats.rays ? 100.0 * stats.resolvedRays / stats.rays : 0.0) << "% resolved by impact parameter";
+    if (stats.packetIssuedSteps) {
+        std::cout << ", packet lanes " << 100.0 * stats.packetUtilisation() << "% busy";
+    }
+    if (stats.filledPixels) {
+        std::cout << ", " << stats.rays << " rays traced and " << stats.filledPixels << " pixels filled in by variable rate";
+    }
+    std::cout << std::endl;
+}
+
+//----------------- Options -----------------
+Offline::Options Offline::parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--size") == 0 && hasValue) {
+            int w = 0, h = 0;
+            if (std::sscanf(argv[++i], "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+                options.width = w;
+                options.height = h;
+            }
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) {
+            options.threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--out") == 0 && hasValue) {
+            options.output = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--no-packets") == 0) {
+            options.packets = false;
+        }
+        else if (std::strcmp(argv[i], "--integrator") == 0 && hasValue) {
+            ++i;
+            if (std::strcmp(argv[i], "dopri5") == 0) options.integrator = IntegratorType::DormandPrince;
+            else if (std::strcmp(argv[i], "binet") == 0) options.integrator = IntegratorType::Binet;
+            else if (std::strcmp(argv[i], "rk4") == 0) options.integrator = IntegratorType::RK4;
+            else std::cerr << "Unknown integrator " << argv[i] << ", using rk4" << std::endl;
+        }
+        else if (std::strcmp(argv[i], "--tolerance") == 0 && hasValue) {
+            float tolerance = static_cast<float>(std::atof(argv[++i]));
+            if (tolerance > 0.0f) options.tolerance = tolerance;
+        }
+        else if (std::strcmp(argv[i], "--no-analytic-escape") == 0) {
+            options.analyticEscape = false;
+        }
+        else if (std::strcmp(argv[i], "--no-classify") == 0) {
+            options.classifyRays = false;
+        }
+        else if (std::strcmp(argv[i], "--no-lut") == 0) {
+            options.deflectionLut = false;
+        }
+        else if (std::strcmp(argv[i], "--variable-rate") == 0) {
+            options.variableRate = true;
+        }
+        else if (std::strcmp(argv[i], "--no-wavefront") == 0) {
+            options.wavefront = false;
+        }
+        else if (std::strcmp(argv[i], "--belt") == 0 && hasValue) {
+            options.belt = std::max(std::atoi(argv[++i]), 0);
+        }
+        else if (std::strcmp(argv[i], "--atlas") == 0 && hasValue) {
+            options.atlas = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--no-atlas") == 0) {
+            options.atlas.clear();
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0 && hasValue) {
+            options.frames = std::max(std::atoi(argv[++i]), 1);
+        }
+        else if (std::strcmp(argv[i], "--hdr-format") == 0 && hasValue) {
+            ++i;
+            if (!HdrFormats::parse(argv[i], options.hdrFormat)) {
+                std::cerr << "Unknown HDR format " << argv[i] << ", using " << HdrFormats::info(options.hdrFormat).name << std::endl;
+            }
+        }
+    }
+    return options;
+}
+
+//----------------- Lensing Atlas -----------------
+int Offline::buildAtlas(const Options& options) {
+    if (options.atlas.empty()) {
+        std::cerr << "No atlas path" << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!LensingAtlas::build(options.atlas)) {
+        std::cerr << "Failed to write " << options.atlas << std::endl;
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Wrote " << options.atlas << ": " << 2 * LensingAtlas::ORBITS << " orbits, "
+        << (LensingAtlas::orbitBytes() + LensingAtlas::sampleBytes()) / (1024.0 * 1024.0) << " MB in "
+        << seconds << " s" << std::endl;
+    return 0;
+}
+
+//----------------- CPU Render -----------------
+int Offline::renderCpu(const Options& options) {
+    Camera camera(60.0f, (float)options.width / options.height, 0.1f, 10000.0f);
+    SceneAssets assets;
+    TraceScene scene;
+    buildDefaultScene(camera, assets, scene, options.belt);
+
+    scene.integrator = options.integrator;
+    scene.tolerance = options.tolerance;
+    scene.analyticEscape = options.analyticEscape;
+    scene.classifyRays = options.classifyRays;
+    scene.deflectionLut = options.deflectionLut;
+    scene.variableRate = options.variableRate;
+    LensingAtlas atlas;
+    if (!options.atlas.empty() && atlas.map(options.atlas)) scene.atlas = &atlas;
+
+    std::vector<float> frame(static_cast<size_t>(options.width) * options.height * 4);
+    CpuTracer tracer(options.threads);
+    tracer.setUsePackets(options.packets);
+    tracer.setWavefront(options.wavefront);
+    bool packets = options.packets && options.integrator == IntegratorType::RK4;
+    const char* integrators[] = { "rk4", "dopri5", "binet" };
+    std::cout << "Integrator: " << integrators[static_cast<int>(options.integrator)]
+        << ", ray packets: " << (packets ? RayPackets::isaName(tracer.packetIsa()) : "off")
+        << ", analytic escape: " << (options.analyticEscape ? "on" : "off")
+        << ", impact classification: " << (options.classifyRays ? "on" : "off")
+        << ", deflection table: " << (options.deflectionLut ? (scene.atlas ? "atlas" : "integrated") : "off")
+        << ", variable rate: " << (options.variableRate ? "on" : "off")
+        << ", wavefront: " << (packets && options.wavefront ? "on" : "off")
+        << ", bodies: " << scene.planets.size() << std::endl;
+    TraceStats stats = tracer.render(scene, options.width, options.height, frame.data());
+    printStats(stats);
+
+    if (!writePPM(options.output, options.width, options.height, frame)) {
+        std::cerr << "Failed to write " << options.output << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << options.output << std::endl;
+    return 0;
+}
+
+//----------------- GPU Render -----------------
+//The windowed renderer's scene and defaults, with the tracing options that map onto it. The context goes
+//first and is destroyed last, the renderer's GL objects need it
+int Offline::renderHeadless(const Options& options) {
+    //Ray packets are the CPU tracer's, geodesic.comp has nothing to switch off
+    if (!options.packets) {
+        std::cerr << "--no-packets only applies to the CPU tracer, not to --headless" << std::endl;
+        return 1;
+    }
+    std::vector<float> frame;
+    try {
+        HeadlessContext context(options.width, options.height);
+        std::cout << "OpenGL version: " << glGetString(GL_VERSION) << ", " << glGetString(GL_RENDERER)
+            << " (" << context.backend() << ")" << std::endl;
+
+        Camera camera(60.0f, (float)options.width / options.height, 0.1f, 10000.0f);
+        Renderer renderer(options.width, options.height, options.hdrFormat, options.atlas);
+        renderer.setOutputFramebuffer(context.framebuffer());
+        renderer.toggleDebugText();//Off, batch frames are for the image
+        //The renderer starts from the same defaults as Options except variable rate, what differs is toggled like the keys would
+        for (int i = 0; i < static_cast<int>(options.integrator); ++i) renderer.toggleIntegrator();
+        renderer.scaleTolerance(options.tolerance / Options().tolerance);
+        if (!options.analyticEscape) renderer.toggleAnalyticEscape();
+        if (!options.classifyRays) renderer.toggleClassifyRays();
+        if (!options.deflectionLut) renderer.toggleDeflectionLut();
+        if (!options.wavefront) renderer.toggleWavefront();
+        if (!options.variableRate) renderer.toggleVariableRate();
+        renderer.setDebrisBelt(options.belt);
+
+        //glFinish closes each frame, the time is the GPU's work and not just the submission
+        double total = 0.0, fastest = 0.0;
+        float fps = 0.0f;
+        for (int i = 0; i < options.frames; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            renderer.render(camera, fps);
+            glFinish();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            fps = ms > 0.0 ? static_cast<float>(1000.0 / ms) : 0.0f;
+            total += ms;
+            fastest = i == 0 ? ms : std::min(fastest, ms);
+            std::printf("Frame %d: %.2f ms\n", i, ms);
+        }
+        std::printf("%d frames in %.1f ms, %.2f ms average, %.2f ms fastest, %.1f frames/s without vsync\n",
+            options.frames, total, total / options.frames, fastest, options.frames * 1000.0 / std::max(total, 1e-3));
+
+        context.readPixels(frame);
+        GLenum error = glGetError();
+        if (error != GL_NO_ERROR) {
+            std::cerr << "OpenGL error 0x" << std::hex << error << std::dec << std::endl;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Headless render failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (!writePPM(options.output, options.width, options.height, frame)) {
+        std::cerr << "Failed to write " << options.output << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << options.output << std::endl;
+    return 0;
+}
+
+int Offline::hdrReport(const Options& options) {
+    Renderer::reportHdrTargets(options.width, options.height, options.hdrFormat);
+    return 0;
+}
+
+//----------------- CPU Benchmark -----------------
+int Offline::benchmarkCpu(const Options& options) {
+    Camera camera(60.0f, (float)options.width / options.height, 0.1f, 10000.0f);
+    SceneAssets assets;
+    TraceScene scene;
+    buildDefaultScene(camera, assets, scene, options.belt);
+
+    scene.integrator = options.integrator;
+    scene.tolerance = options.tolerance;
+    scene.analyticEscape = options.analyticEscape;
+    scene.classifyRays = options.classifyRays;
+    scene.deflectionLut = options.deflectionLut;
+    scene.variableRate = options.variableRate;
+    LensingAtlas atlas;
+    if (!options.atlas.empty() && atlas.map(options.atlas)) scene.atlas = &atlas;
+
+    unsigned maxThreads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<float> frame(static_cast<size_t>(options.width) * options.height * 4);
+
+    double baseline = 0.0;
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        CpuTracer tracer(threads);
+        tracer.setUsePackets(options.packets);
+        tracer.setWavefront(options.wavefront);
+        TraceStats stats = tracer.render(scene, options.width, options.height, frame.data());
+        if (threads == 1) baseline = stats.stepsPerSecond();
+        printStats(stats);
+        if (baseline > 0.0) {
+            double speedup = stats.stepsPerSecond() / baseline;
+            std::cout << "    speedup " << speedup << "x, efficiency " << 100.0 * speedup / threads << "%" << std::endl;
+        }
+        if (threads == maxThreads) break;
+    }
+    return 0;
+}
+
+//----------------- Packet Benchmark -----------------
+//Scalar port of the shader loop with the same stop conditions as the packet kernel
+//Disk crossings are counted but the ray keeps going, like the kernel after LANE_SKIP_DISK
+static uint64_t marchScalar(const PacketParams& params, const BodyBvh::Tree& planets, glm::vec3 pos, glm::vec3 dir) {
+    uint64_t steps = 0;
+    for (int i = 0; i < params.maxSteps; ++i) {
+        float r = glm::length(pos);
+        if (r < params.rs || r > params.escapeRadius) break;
+        glm::vec3 from = pos;
+        Physics::rk4Step(pos, dir, params.stepSize, params.rs);
+        ++steps;
+        float t;
+        if (BodyBvh::firstHit(planets, from, pos, t) >= 0) break;
+    }
+    return steps;
+}
+
+int Offline::benchmarkPacket(const Options& options) {
+    Camera camera(60.0f, (float)options.width / options.height, 0.1f, 10000.0f);
+    SceneAssets assets;
+    TraceScene scene;
+    buildDefaultScene(camera, assets, scene, options.belt);
+
+    BodyBvh::Tree planets;
+    for (const TracePlanet& planet : scene.planets) {
+        planets.spheres.push_back(glm::vec4(planet.position, planet.radius));
+    }
+    BodyBvh::build(planets);
+    PacketParams params;
+    params.rs = scene.bhRadius;
+    params.diskInnerRadius = scene.diskInnerRadius;
+    params.diskOuterRadius = scene.diskOuterRadius;
+    PacketPlanetArrays planetArrays;
+    params.planets = RayPackets::flattenPlanets(planets, planetArrays);
+
+    //Every camera ray of the frame, padded to whole packets
+    std::vector<glm::vec3> dirs;
+    glm::vec2 resolution(static_cast<float>(options.width), static_cast<float>(options.height));
+    for (int y = 0; y < options.height; ++y) {
+        for (int x = 0; x < options.width; ++x) {
+            dirs.push_back(Physics::generateRay(scene.invView, scene.invProj, glm::vec2(x + 0.5f, y + 0.5f), resolution));
+        }
+    }
+    while (dirs.size() % PACKET_LANES) dirs.push_back(dirs.back());
+
+    auto now = [] { return std::chrono::steady_clock::now(); };
+    auto seconds = [](std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+        return std::chrono::duration<double>(b - a).count();
+    };
+
+    auto t0 = now();
+    uint64_t scalarSteps = 0;
+    for (const glm::vec3& dir : dirs) {
+        scalarSteps += marchScalar(params, planets, scene.camPos, dir);
+    }
+    double scalarRate = scalarSteps / seconds(t0, now());
+    std::cout << "scalar rk4Step port: " << scalarRate / 1e6 << " Msteps/s (" << scalarSteps << " steps)" << std::endl;
+
+    PacketIsa best = RayPackets::detectIsa();
+    PacketIsa isas[] = { PacketIsa::Scalar, PacketIsa::AVX2, PacketIsa::AVX512 };
+    for (PacketIsa isa : isas) {
+        if (static_cast<int>(isa) > static_cast<int>(best)) break;
+
+        uint64_t steps = 0;
+        auto t1 = now();
+        for (size_t first = 0; first < dirs.size(); first += PACKET_LANES) {
+            RayPacket packet;
+            for (int i = 0; i < PACKET_LANES; ++i) {
+                packet.px[i] = scene.camPos.x;
+                packet.py[i] = scene.camPos.y;
+                packet.pz[i] = scene.camPos.z;
+                packet.dx[i] = dirs[first + i].x;
+                packet.dy[i] = dirs[first + i].y;
+                packet.dz[i] = dirs[first + i].z;
+                packet.status[i] = LANE_ACTIVE;
+                packet.steps[i] = 0;
+                packet.planet[i] = -1;
+                packet.flags[i] = 0;
+            }
+
+			//Resume disk lanes until every lane has stopped for good
+            bool resumed = true;
+            while (resumed) {
+                steps += RayPackets::advance(isa, packet, params);
+                resumed = false;
+                for (int i = 0; i < PACKET_LANES; ++i) {
+                    if (packet.status[i] == LANE_DISK) {
+                        packet.status[i] = LANE_ACTIVE;
+                        packet.flags[i] |= LANE_SKIP_DISK;
+                        resumed = true;
+                    }
+                }
+            }
+        }
+        double rate = steps / seconds(t1, now());
+        std::cout << RayPackets::isaName(isa) << " packets: " << rate / 1e6 << " Msteps/s (" << steps << " steps), "
+            << rate / scalarRate << "x scalar port" << std::endl;
+    }
+    return 0;
+}
+
+//----------------- Accuracy -----------------
+int Offline::accuracyReport(const Options& options) {
+    Camera camera(60.0f, (float)options.width / options.height, 0.1f, 10000.0f);
+    SceneAssets assets;
+    TraceScene scene;
+    buildDefaultScene(camera, assets, scene, options.belt);
+
+    //Centre ray of every tile
+    std::vector<glm::vec3> origins, dirs;
+    glm::vec2 resolution(static_cast<float>(options.width), static_cast<float>(options.height));
+    const int T = CpuTracer::TILE_SIZE;
+    for (int y = T / 2; y < options.height; y += T) {
+        for (int x = T / 2; x < options.width; x += T) {
+            origins.push_back(scene.camPos);
+            dirs.push_back(Physics::generateRay(scene.invView, scene.invProj, glm::vec2(x + 0.5f, y + 0.5f), resolution));
+        }
+    }
+
+    std::vector<RayOutcome> reference(dirs.size());
+    TileScheduler scheduler(options.threads);
+    scheduler.run(static_cast<int>(dirs.size()), 1, [&](int i, int, unsigned) {
+        reference[i] = Accuracy::traceReference(glm::dvec3(origins[i]), glm::dvec3(dirs[i]), scene.bhRadius);
+    });
+    size_t captured = 0;
+    for (const RayOutcome& outcome : reference) captured += outcome.captured ? 1 : 0;
+    std::cout << dirs.size() << " rays, " << captured << " captured by the reference" << std::endl;
+
+    //Errors are also given in pixels so it is clear when the image changes visibly
+    const double degrees = 180.0 / 3.14159265358979323846;
+    const double pixelAngle = glm::radians(60.0) / options.height;
+    std::vector<IntegratorMode> modes = Accuracy::modes();
+    LensingAtlas atlas;
+    if (!options.atlas.empty() && atlas.map(options.atlas)) {
+        std::vector<IntegratorMode> fromAtlas = Accuracy::atlasModes(atlas);
+        modes.insert(modes.end(), fromAtlas.begin(), fromAtlas.end());
+    }
+    for (const IntegratorMode& mode : modes) {
+        AccuracyReport report = Accuracy::measure(mode, origins, dirs, reference, scene.bhRadius, options.threads);
+        std::cout << report.name << ": deflection error mean " << report.meanError * degrees << " deg ("
+            << report.meanError / pixelAngle << " px), p99 " << report.p99Error * degrees << " deg ("
+            << report.p99Error / pixelAngle << " px), max " << report.maxError * degrees << " deg" << std::endl;
+        std::cout << "    misclassified " << report.misclassified() << " (" << report.falseCaptures << " false captures, "
+            << report.falseEscapes << " false escapes), " << static_cast<double>(report.steps) / report.rays << " steps/ray, "
+            << report.seconds * 1000.0 << " ms" << std::endl;
+    }
+    return 0;
+}
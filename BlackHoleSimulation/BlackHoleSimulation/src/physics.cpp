@@ -1 +1,1284 @@
-//Calculations and geodesics
\ No newline at end of file
+/*
+	CPU geodesic tracer
+	Port of shaders/geodesic.comp for machines without an OpenGL 4.3 GPU
+    Same ray generation, RK4 / Dormand-Prince / Binet integration, disk, planet and skybox shading
+*/
+
+#include "../headers/physics.hpp"
+#include "../headers/deflectionLut.hpp"
+#include <stb_image.h>
+#include <chrono>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+#include <random>
+
+static const float PI = 3.14159265f;
+
+//----------------- Integration -----------------
+//Schwarzschild "acceleration" for photon (approximate, for visualization)
+glm::vec3 Physics::schwarzschildAccel(const glm::vec3& pos, float rs) {
+    float r = glm::length(pos);
+    return -rs / (r * r) * glm::normalize(pos);
+}
+
+//Runge-Kutta 4th order integration step for ray position and direction
+void Physics::rk4Step(glm::vec3& pos, glm::vec3& dir, float stepSize, float rs) {
+    glm::vec3 k1_v = schwarzschildAccel(pos, rs);
+    glm::vec3 k1_x = dir;
+
+    glm::vec3 k2_v = schwarzschildAccel(pos + 0.5f * stepSize * k1_x, rs);
+    glm::vec3 k2_x = glm::normalize(dir + 0.5f * stepSize * k1_v);
+
+    glm::vec3 k3_v = schwarzschildAccel(pos + 0.5f * stepSize * k2_x, rs);
+    glm::vec3 k3_x = glm::normalize(dir + 0.5f * stepSize * k2_v);
+
+    glm::vec3 k4_v = schwarzschildAccel(pos + stepSize * k3_x, rs);
+    glm::vec3 k4_x = glm::normalize(dir + stepSize * k3_v);
+
+    dir = glm::normalize(dir + (stepSize / 6.0f) * (k1_v + 2.0f * k2_v + 2.0f * k3_v + k4_v));
+    pos = pos + (stepSize / 6.0f) * (k1_x + 2.0f * k2_x + 2.0f * k3_x + k4_x);
+}
+
+//Dormand-Prince 5(4) tableau
+static const float DP_A21 = 1.0f / 5.0f;
+static const float DP_A31 = 3.0f / 40.0f, DP_A32 = 9.0f / 40.0f;
+static const float DP_A41 = 44.0f / 45.0f, DP_A42 = -56.0f / 15.0f, DP_A43 = 32.0f / 9.0f;
+static const float DP_A51 = 19372.0f / 6561.0f, DP_A52 = -25360.0f / 2187.0f, DP_A53 = 64448.0f / 6561.0f, DP_A54 = -212.0f / 729.0f;
+static const float DP_A61 = 9017.0f / 3168.0f, DP_A62 = -355.0f / 33.0f, DP_A63 = 46732.0f / 5247.0f, DP_A64 = 49.0f / 176.0f, DP_A65 = -5103.0f / 18656.0f;
+static const float DP_B1 = 35.0f / 384.0f, DP_B3 = 500.0f / 1113.0f, DP_B4 = 125.0f / 192.0f, DP_B5 = -2187.0f / 6784.0f, DP_B6 = 11.0f / 84.0f;
+//5th minus embedded 4th order weights
+static const float DP_E1 = 71.0f / 57600.0f, DP_E3 = -71.0f / 16695.0f, DP_E4 = 71.0f / 1920.0f, DP_E5 = -17253.0f / 339200.0f, DP_E6 = 22.0f / 525.0f, DP_E7 = -1.0f / 40.0f;
+
+//Steps below this are accepted whatever the error, so a ray can't stall
+static const float DP_MIN_STEP = 1e-3f;
+
+//Part of the acceleration perpendicular to the ray direction
+static glm::vec3 bend(const glm::vec3& accel, const glm::vec3& dir) {
+    return accel - glm::dot(accel, dir) * dir;
+}
+
+int Physics::dopri5Step(glm::vec3& pos, glm::vec3& dir, glm::vec3& accel, float& stepSize, float maxStep, float rs, float tolerance) {
+    int attempts = 0;
+    float h = std::max(std::min(stepSize, maxStep), DP_MIN_STEP);
+
+    for (;;) {
+        ++attempts;
+
+        //dx/ds = v, dv/ds = a(x) - (a.v) v: only the part of the pull across the ray bends it, so
+        //|v| stays 1 like the normalized stages of rk4Step. The position slopes are the v stages
+        glm::vec3 v1 = dir;
+        glm::vec3 k1 = bend(accel, v1);
+        glm::vec3 v2 = dir + h * (DP_A21 * k1);
+        glm::vec3 k2 = bend(schwarzschildAccel(pos + h * (DP_A21 * v1), rs), v2);
+        glm::vec3 v3 = dir + h * (DP_A31 * k1 + DP_A32 * k2);
+        glm::vec3 k3 = bend(schwarzschildAccel(pos + h * (DP_A31 * v1 + DP_A32 * v2), rs), v3);
+        glm::vec3 v4 = dir + h * (DP_A41 * k1 + DP_A42 * k2 + DP_A43 * k3);
+        glm::vec3 k4 = bend(schwarzschildAccel(pos + h * (DP_A41 * v1 + DP_A42 * v2 + DP_A43 * v3), rs), v4);
+        glm::vec3 v5 = dir + h * (DP_A51 * k1 + DP_A52 * k2 + DP_A53 * k3 + DP_A54 * k4);
+        glm::vec3 k5 = bend(schwarzschildAccel(pos + h * (DP_A51 * v1 + DP_A52 * v2 + DP_A53 * v3 + DP_A54 * v4), rs), v5);
+        glm::vec3 v6 = dir + h * (DP_A61 * k1 + DP_A62 * k2 + DP_A63 * k3 + DP_A64 * k4 + DP_A65 * k5);
+        glm::vec3 k6 = bend(schwarzschildAccel(pos + h * (DP_A61 * v1 + DP_A62 * v2 + DP_A63 * v3 + DP_A64 * v4 + DP_A65 * v5), rs), v6);
+
+        glm::vec3 newPos = pos + h * (DP_B1 * v1 + DP_B3 * v3 + DP_B4 * v4 + DP_B5 * v5 + DP_B6 * v6);
+        glm::vec3 v7 = dir + h * (DP_B1 * k1 + DP_B3 * k3 + DP_B4 * k4 + DP_B5 * k5 + DP_B6 * k6);
+        glm::vec3 a7 = schwarzschildAccel(newPos, rs);
+        glm::vec3 k7 = bend(a7, v7);
+
+        //Position error relative to the radius, direction error is an angle
+        glm::vec3 errPos = h * (DP_E1 * v1 + DP_E3 * v3 + DP_E4 * v4 + DP_E5 * v5 + DP_E6 * v6 + DP_E7 * v7);
+        glm::vec3 errDir = h * (DP_E1 * k1 + DP_E3 * k3 + DP_E4 * k4 + DP_E5 * k5 + DP_E6 * k6 + DP_E7 * k7);
+        float err = std::max(glm::length(errPos) / std::max(glm::length(pos), 1.0f), glm::length(errDir));
+
+        //Standard controller: 0.9 * (tol / err)^(1/5), growth limited to 0.2x .. 5x
+        float factor = err > 0.0f ? 0.9f * std::pow(tolerance / err, 0.2f) : 5.0f;
+        factor = glm::clamp(factor, 0.2f, 5.0f);
+
+        if (err <= tolerance || h <= DP_MIN_STEP) {
+            pos = newPos;
+            dir = glm::normalize(v7);
+            accel = a7;
+            stepSize = h * factor;
+            return attempts;
+        }
+        h = std::max(h * factor, DP_MIN_STEP);
+    }
+}
+
+//Orbital plane setup, same as orbitFromRay in geodesic.comp
+bool Physics::orbitFromRay(const glm::vec3& pos, const glm::vec3& dir, OrbitState& orbit) {
+    float r = glm::length(pos);
+    orbit.e1 = pos / r;
+    float dr = glm::dot(dir, orbit.e1);
+    glm::vec3 tangent = dir - dr * orbit.e1;
+    float dt = glm::length(tangent);
+    if (dt < 1e-4f) return false;
+
+    orbit.e2 = tangent / dt;
+    orbit.u = 1.0f / r;
+    orbit.w = -orbit.u * dr / dt;
+    orbit.phi = 0.0f;
+    return true;
+}
+
+void Physics::binetStep(OrbitState& orbit, float dphi, float rs) {
+    float k = 1.5f * rs;
+    float u = orbit.u, w = orbit.w;
+
+    float k1u = w, k1w = -u + k * u * u;
+    float u2 = u + 0.5f * dphi * k1u;
+    float k2u = w + 0.5f * dphi * k1w, k2w = -u2 + k * u2 * u2;
+    float u3 = u + 0.5f * dphi * k2u;
+    float k3u = w + 0.5f * dphi * k2w, k3w = -u3 + k * u3 * u3;
+    float u4 = u + dphi * k3u;
+    float k4u = w + dphi * k3w, k4w = -u4 + k * u4 * u4;
+
+    orbit.u = u + dphi / 6.0f * (k1u + 2.0f * k2u + 2.0f * k3u + k4u);
+    orbit.w = w + dphi / 6.0f * (k1w + 2.0f * k2w + 2.0f * k3w + k4w);
+    orbit.phi += dphi;
+}
+
+//ds = sqrt(dr^2 + r^2 dphi^2) = dphi * sqrt(w^2 + u^2) / u^2
+float Physics::binetAngleStep(const OrbitState& orbit, float stepSize) {
+    return stepSize * orbit.u * orbit.u / std::sqrt(orbit.w * orbit.w + orbit.u * orbit.u);
+}
+
+//d(pos)/dphi is proportional to -w * radial + u * tangential
+void Physics::orbitToRay(const OrbitState& orbit, glm::vec3& pos, glm::vec3& dir) {
+    float c = std::cos(orbit.phi), s = std::sin(orbit.phi);
+    glm::vec3 radial = c * orbit.e1 + s * orbit.e2;
+    glm::vec3 tangential = c * orbit.e2 - s * orbit.e1;
+    pos = radial / orbit.u;
+    dir = glm::normalize(-orbit.w * radial + orbit.u * tangential);
+}
+
+//Straight line approximation of the remaining path, the pull across it integrates to
+//rs * b / (b^2 + s^2)^(3/2) from s = r mu to infinity, b = r sqrt(1 - mu^2)
+float Physics::escapeDeflection(const glm::vec3& pos, const glm::vec3& dir, float rs) {
+    float r = glm::length(pos);
+    float mu = glm::clamp(glm::dot(pos, dir) / r, -1.0f, 1.0f);
+    return rs / r * std::sqrt((1.0f - mu) / (1.0f + mu));
+}
+
+//8 point Gauss-Legendre rule on [0, 1]
+static const int ESCAPE_NODES = 8;
+static const float ESCAPE_X[ESCAPE_NODES] = { 0.019855072f, 0.101666761f, 0.237233795f, 0.408282679f, 0.591717321f, 0.762766205f, 0.898333239f, 0.980144928f };
+static const float ESCAPE_W[ESCAPE_NODES] = { 0.050614268f, 0.111190517f, 0.156853323f, 0.181341892f, 0.181341892f, 0.156853323f, 0.111190517f, 0.050614268f };
+
+//Both escape integrals are taken over theta, the angle along the straight line orbit u = sin(theta) / b
+//through the current point, from infinity (theta = 0) to here (theta = thetaC)
+//In flat space the integrand is exactly 1, gravity adds a smooth O(rs u) correction
+
+//With beta the angle between dir and the radial direction, the rk4Step force law gives
+//dbeta/dr = -tan(beta) (r - rs) / r^2, so r sin(beta) e^(rs / r) is conserved
+//The ray leaves along the radial direction at phi + dphi, with E = e^(2 rs (u0 - u)):
+//dphi = integral of sqrt(E) / sqrt(1 - tan^2(theta) (E - 1)) dtheta, thetaC = beta
+glm::vec3 Physics::escapeDirection(const glm::vec3& pos, const glm::vec3& dir, float rs) {
+    float r = glm::length(pos);
+    glm::vec3 radial = pos / r;
+    float mu = glm::dot(radial, dir);
+    glm::vec3 tangent = dir - mu * radial;
+    float sinBeta = glm::length(tangent);
+    if (sinBeta < 1e-6f) return dir;//Radial, no bending
+    tangent /= sinBeta;
+
+    float thetaC = std::atan2(sinBeta, mu);
+    float b = r * sinBeta;
+    float dphi = 0.0f;
+    for (int i = 0; i < ESCAPE_NODES; ++i) {
+        float theta = thetaC * ESCAPE_X[i];
+        float du = (sinBeta - std::sin(theta)) / b;
+        float tanTheta = std::tan(theta);
+        float E1 = std::expm1(2.0f * rs * du);
+        dphi += ESCAPE_W[i] * std::exp(rs * du) / std::sqrt(std::max(1.0f - tanTheta * tanTheta * E1, 1e-12f));
+    }
+    dphi *= thetaC;
+    return std::cos(dphi) * radial + std::sin(dphi) * tangent;
+}
+
+//Binet first integral w^2 + u^2 - rs u^3 = 1/b^2, the rest of the orbit sweeps
+//dphi = integral of 1 / sqrt(1 - rs B (sin^3(thetaC) - sin^3(theta)) / cos^2(theta)) dtheta,
+//1/B^2 = w^2 + u^2, sin(thetaC) = u B
+glm::vec3 Physics::binetEscapeDirection(const OrbitState& orbit, float rs) {
+    float B = 1.0f / std::sqrt(orbit.w * orbit.w + orbit.u * orbit.u);
+    float thetaC = std::atan2(orbit.u, -orbit.w);
+    float sinC = orbit.u * B;
+    float dphi = 0.0f;
+    for (int i = 0; i < ESCAPE_NODES; ++i) {
+        float s = std::sin(thetaC * ESCAPE_X[i]);
+        //(sinC^3 - s^3) / (1 - s^2) without dividing two small numbers near thetaC = pi / 2
+        float q = (sinC - s) / (1.0f - s) * (sinC * sinC + sinC * s + s * s) / (1.0f + s);
+        dphi += ESCAPE_W[i] / std::sqrt(std::max(1.0f - rs / B * q, 1e-12f));
+    }
+    dphi *= thetaC;
+
+    float phi = orbit.phi + dphi;
+    return std::cos(phi) * orbit.e1 + std::sin(phi) * orbit.e2;
+}
+
+//----------------- Impact Classification -----------------
+//Relative width of the band around the critical impact parameter that is always marched, covers the
+//fixed step integrators' error near the photon orbit and keeps the periapsis solves well conditioned
+static const float IMPACT_BAND = 0.05f;
+
+//(e^x - 1) / x, series below 1e-2 where the subtraction loses precision
+static float expm1OverX(float x) {
+    return x < 1e-2f ? 1.0f + x * (0.5f + x / 6.0f) : std::expm1(x) / x;
+}
+
+//Orbit angle from theta0 to pi / 2 with u = up sin(theta), up the periapsis and a = rs up
+//In flat space the integrand is 1, the square root endpoint at the periapsis has been divided out
+static float periapsisSweep(float theta0, float a, bool binet) {
+    const float HALF_PI = 1.57079632679f;
+    float span = HALF_PI - theta0;
+    float phi = 0.0f;
+    for (int i = 0; i < ESCAPE_NODES; ++i) {
+        float s = std::sin(theta0 + span * ESCAPE_X[i]);
+        float f;
+        if (binet) {
+            //1/b^2 - u^2 + rs u^3 = up^2 (1 - s) ((1 + s) - a (1 + s + s^2))
+            f = std::sqrt((1.0f + s) / std::max((1.0f + s) - a * (1.0f + s + s * s), 1e-12f));
+        }
+        else {
+            //sin(beta) = s e^(a (1 - s)), cos(beta)^2 = (1 - s) ((1 + s) - s^2 (e^(2a(1 - s)) - 1) / (1 - s))
+            float x = 2.0f * a * (1.0f - s);
+            f = std::exp(0.5f * x) * std::sqrt((1.0f + s) / std::max((1.0f + s) - s * s * 2.0f * a * expm1OverX(x), 1e-12f));
+        }
+        phi += ESCAPE_W[i] * f;
+    }
+    return phi * span;
+}
+
+//The invariants are K = r sin(beta) e^(rs / r) for the rk4Step force law (critical e rs, where
+//r e^(rs / r) has its minimum) and b with 1/b^2 = w^2 + u^2 - rs u^3 for Binet (critical 3 sqrt(3) / 2 rs)
+//Sweep bounds come from the orbit equations dphi/du = tan(beta) / u >= K e^(-rs u) and
+//dphi/du = 1 / sqrt(1/b^2 - u^2 (1 - rs u)) >= b, the upper bounds from the largest sin(beta) or
+//u^2 (1 - rs u) reached inside the inner radius
+RayFate Physics::classifyImpact(const glm::vec3& pos, const glm::vec3& dir, float rs, bool binet, float innerRadius, float outerRadius, ImpactSweep& sweep) {
+    float r0 = glm::length(pos);
+    glm::vec3 radial = pos / r0;
+    float mu = glm::dot(radial, dir);
+    glm::vec3 tangent = dir - mu * radial;
+    float sinBeta = glm::length(tangent);
+    if (mu >= 0.0f || sinBeta < 1e-6f || r0 < 2.0f * rs) return RayFate::Ambiguous;
+    sweep.e1 = radial;
+    sweep.e2 = tangent / sinBeta;
+
+    float u0 = 1.0f / r0;
+    float uOuter = 1.0f / outerRadius;
+    float uInner = std::min(1.0f / innerRadius, 1.0f / rs);
+    float impact = binet ? 1.0f / std::sqrt(u0 * u0 / (sinBeta * sinBeta) - rs * u0 * u0 * u0) : r0 * sinBeta * std::exp(rs * u0);
+    float critical = binet ? 2.59807621f * rs : 2.71828183f * rs;
+
+    //Angle swept from u0 to u (inbound) or from u to 0 (outbound), lower bounds
+    auto inbound = [&](float u) {
+        if (u <= u0) return 0.0f;
+        return binet ? impact * (u - u0) : impact * (std::exp(-rs * u0) - std::exp(-rs * u)) / rs;
+    };
+    auto outbound = [&](float u) {
+        return binet ? impact * u : impact * (1.0f - std::exp(-rs * u)) / rs;
+    };
+
+    if (impact < critical * (1.0f - IMPACT_BAND)) {
+        sweep.phiEnter = inbound(uOuter);
+        if (uInner <= u0) {
+            sweep.phiLeave = 0.0f;//Already inside the inner radius
+        }
+        else if (binet) {
+            float uMax = std::min(uInner, 2.0f / (3.0f * rs));
+            float radicand = 1.0f / (impact * impact) - uMax * uMax * (1.0f - rs * uMax);
+            sweep.phiLeave = (uInner - u0) / std::sqrt(radicand);
+        }
+        else {
+            float sinMax = impact * uInner * std::exp(-rs * uInner);
+            sweep.phiLeave = inbound(uInner) / std::sqrt(1.0f - sinMax * sinMax);
+        }
+        return RayFate::Captured;
+    }
+
+    if (impact > critical * (1.0f + IMPACT_BAND)) {
+        //a = rs / periapsis
+        float a;
+        if (binet) {
+            //Smallest positive root of a^2 - a^3 = (rs / b)^2, trigonometric cubic plus a Newton polish
+            float q = rs * rs / (impact * impact);
+            a = 1.0f / 3.0f + 2.0f / 3.0f * std::cos(std::acos(1.0f - 13.5f * q) / 3.0f - 2.09439510f);
+            a -= (a * a - a * a * a - q) / (2.0f * a - 3.0f * a * a);
+        }
+        else {
+            //a e^-a = rs / K, Newton on a - ln(a) = ln(K / rs) converges from below
+            float lnK = std::log(impact / rs);
+            a = rs / impact;
+            for (int i = 0; i < 6; ++i) {
+                a -= (a - std::log(a) - lnK) / (1.0f - 1.0f / a);
+            }
+        }
+        sweep.periapsis = rs / a;
+        float theta0 = std::asin(std::min(sweep.periapsis * u0, 1.0f));
+        sweep.phiEscape = periapsisSweep(0.0f, a, binet) + periapsisSweep(theta0, a, binet);
+
+        if (sweep.periapsis < outerRadius) {
+            sweep.phiEnter = inbound(uOuter);
+            sweep.phiLeave = sweep.phiEscape - outbound(uOuter);
+        }
+        else {
+            sweep.phiEnter = 0.0f;
+            sweep.phiLeave = -1.0f;
+        }
+        return RayFate::Escapes;
+    }
+    return RayFate::Ambiguous;
+}
+
+//Generate a world space ray direction from pixel coordinates
+glm::vec3 Physics::generateRay(const glm::mat4& invView, const glm::mat4& invProj, glm::vec2 pixel, glm::vec2 resolution) {
+    glm::vec2 ndc = (pixel / resolution) * 2.0f - glm::vec2(1.0f);
+    glm::vec4 clip(ndc.x, ndc.y, -1.0f, 1.0f);
+    glm::vec4 eye = invProj * clip;
+    eye = glm::vec4(eye.x, eye.y, -1.0f, 0.0f);
+    return glm::normalize(glm::vec3(invView * eye));
+}
+
+//----------------- Debris Belt -----------------
+glm::vec3 BeltBody::position(float angle) const {
+    float x = orbitRadius * std::cos(angle);
+    float z = orbitRadius * std::sin(angle);
+    return glm::vec3(x, z * std::sin(orbitInclination), z * std::cos(orbitInclination));
+}
+
+std::vector<BeltBody> Physics::debrisBelt(int count, float rs) {
+    //Fixed seed, every run and both paths get the same belt
+    std::mt19937 rng(1234u);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<BeltBody> belt(count);
+    for (BeltBody& body : belt) {
+        body.orbitRadius = rs * (12.0f + 6.0f * unit(rng));
+        body.orbitPhase = 2.0f * PI * unit(rng);
+        body.orbitInclination = 0.2f + 0.05f * (2.0f * unit(rng) - 1.0f);
+        //Mostly small, a few larger rocks
+        float size = unit(rng);
+        body.radius = rs * (0.02f + 0.06f * size * size * size);
+        float shade = 0.35f + 0.3f * unit(rng);
+        body.color = glm::vec3(shade, shade * 0.9f, shade * 0.8f);
+    }
+    return belt;
+}
+
+//----------------- Textures -----------------
+bool CpuTexture::load(const std::string& path) {
+    int channels;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (!data) return false;
+    pixels.assign(data, data + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(data);
+    return true;
+}
+
+//Bilinear lookup matching GL_LINEAR without mipmaps
+glm::vec4 CpuTexture::sample(glm::vec2 uv) const {
+    if (pixels.empty()) return glm::vec4(0.0f);
+
+    float fx = uv.x * width - 0.5f;
+    float fy = uv.y * height - 0.5f;
+    int x0 = static_cast<int>(std::floor(fx));
+    int y0 = static_cast<int>(std::floor(fy));
+    float tx = fx - x0;
+    float ty = fy - y0;
+
+    auto wrap = [this](int i, int size) {
+        if (repeat) {
+            i %= size;
+            return i < 0 ? i + size : i;
+        }
+        return std::min(std::max(i, 0), size - 1);
+    };
+    int xa = wrap(x0, width), xb = wrap(x0 + 1, width);
+    int ya = wrap(y0, height), yb = wrap(y0 + 1, height);
+
+    auto texel = [this](int x, int y) {
+        const unsigned char* p = &pixels[(static_cast<size_t>(y) * width + x) * 4];
+        return glm::vec4(p[0], p[1], p[2], p[3]) * (1.0f / 255.0f);
+    };
+    glm::vec4 top = glm::mix(texel(xa, ya), texel(xb, ya), tx);
+    glm::vec4 bottom = glm::mix(texel(xa, yb), texel(xb, yb), tx);
+    return glm::mix(top, bottom, ty);
+}
+
+bool CpuCubemap::load(const std::vector<std::string>& paths) {
+    for (int i = 0; i < 6 && i < static_cast<int>(paths.size()); ++i) {
+        if (!faces[i].load(paths[i])) return false;
+        faces[i].repeat = false;
+    }
+    return paths.size() >= 6;
+}
+
+//Face selection follows the GL cube map major axis table
+glm::vec3 CpuCubemap::sample(const glm::vec3& dir) const {
+    glm::vec3 a = glm::abs(dir);
+    int face;
+    float sc, tc, ma;
+    if (a.x >= a.y && a.x >= a.z) {
+        face = dir.x > 0.0f ? 0 : 1;
+        sc = dir.x > 0.0f ? -dir.z : dir.z;
+        tc = -dir.y;
+        ma = a.x;
+    }
+    else if (a.y >= a.z) {
+        face = dir.y > 0.0f ? 2 : 3;
+        sc = dir.x;
+        tc = dir.y > 0.0f ? dir.z : -dir.z;
+        ma = a.y;
+    }
+    else {
+        face = dir.z > 0.0f ? 4 : 5;
+        sc = dir.z > 0.0f ? dir.x : -dir.x;
+        tc = -dir.y;
+        ma = a.z;
+    }
+    glm::vec2 uv((sc / ma + 1.0f) * 0.5f, (tc / ma + 1.0f) * 0.5f);
+    return glm::vec3(faces[face].sample(uv));
+}
+
+//----------------- Shading helpers -----------------
+//Same hash and value noise as geodesic.comp
+static float hash(float n) {
+    return glm::fract(std::sin(n) * 43758.5453f);
+}
+
+static float noise(glm::vec2 x) {
+    glm::vec2 p(std::floor(x.x), std::floor(x.y));
+    glm::vec2 f(x.x - p.x, x.y - p.y);
+    f = f * f * (glm::vec2(3.0f) - 2.0f * f);
+    float n = p.x + p.y * 57.0f;
+    return glm::mix(
+        glm::mix(hash(n + 0.0f), hash(n + 1.0f), f.x),
+        glm::mix(hash(n + 57.0f), hash(n + 58.0f), f.x),
+        f.y
+    );
+}
+
+//Disk emission for a ray crossing the disk plane at pos
+static glm::vec3 shadeDisk(const TraceScene& scene, const glm::vec3& pos, const glm::vec3& dir, const glm::vec3& rayOrigin, float diskR, float stepSize) {
+    const glm::vec3 innerColor(0.7f, 0.85f, 1.0f);
+    const glm::vec3 outerColor(1.0f, 0.4f, 0.1f);
+
+    //Relativistic Doppler and beaming
+    glm::vec3 diskTangent = glm::normalize(glm::vec3(-pos.z, 0.0f, pos.x));
+    float v = 0.75f;
+    glm::vec3 vDisk = v * diskTangent;
+    glm::vec3 photonDir = -glm::normalize(dir);
+    float beta = v;
+    float cosTheta = glm::dot(glm::normalize(vDisk), photonDir);
+    float gamma = 1.0f / std::sqrt(1.0f - beta * beta);
+    float D = gamma * (1.0f - beta * cosTheta);
+
+    //Disk local coordinates
+    float phi = std::atan2(pos.x, pos.z) + scene.time * 1.0f;
+    float t = glm::clamp((diskR - scene.diskInnerRadius) / (scene.diskOuterRadius - scene.diskInnerRadius), 0.0f, 1.0f);
+
+    float baseU = phi / (2.0f * PI);
+    baseU = baseU - std::floor(baseU);
+    float baseV = t;
+
+    const float margin = 0.08f;
+    glm::vec2 texCoords(glm::mix(margin, 1.0f - margin, baseU), glm::mix(margin, 1.0f - margin, baseV));
+
+    float smoke = scene.assets ? scene.assets->smoke.sample(texCoords).a : 0.0f;
+    float combined = glm::mix(noise(texCoords * 8.0f + glm::vec2(scene.time * 0.1f)), smoke, 0.95f);
+
+    float heightFalloff = std::exp(-std::fabs(pos.y) * 2.0f);
+    float edgeFade = glm::smoothstep(scene.diskInnerRadius, scene.diskInnerRadius + 0.5f, diskR) *
+                     (1.0f - glm::smoothstep(scene.diskOuterRadius - 0.5f, scene.diskOuterRadius, diskR));
+
+    glm::vec3 baseColor = glm::mix(innerColor, outerColor, t);
+    baseColor += glm::vec3(0.25f * combined);
+    baseColor = glm::clamp(baseColor, 0.0f, 1.0f);
+    baseColor *= heightFalloff * edgeFade;
+
+    glm::vec3 diskCol = glm::pow(baseColor, glm::vec3(1.0f / D, 1.0f, D)) * (1.0f / D);
+
+    //Gravitational redshift
+    float gRedshift = std::sqrt(1.0f - scene.bhRadius / diskR);
+    diskCol = glm::mix(glm::vec3(diskCol.r, 0.0f, 0.0f), diskCol, gRedshift);
+
+    //Lambertian shading
+    const glm::vec3 normal(0.0f, 1.0f, 0.0f);
+    const glm::vec3 lightDir = glm::normalize(glm::vec3(0.3f, 1.0f, 0.3f));
+    float diffuse = std::max(glm::dot(normal, lightDir), 0.0f);
+
+    //Analytical black hole shadow, limited to the disk
+    glm::vec3 shadowOrigin = pos + 0.01f * lightDir;
+    glm::vec3 oc = shadowOrigin - scene.bhPosition;
+    float b = glm::dot(oc, lightDir);
+    float c = glm::dot(oc, oc) - scene.bhRadius * scene.bhRadius;
+    float discriminant = b * b - c;
+    bool inShadow = false;
+    if (discriminant > 0.0f) {
+        float ts = -b - std::sqrt(discriminant);
+        if (ts > 0.0f && ts < 30.0f) {
+            glm::vec3 shadowHit = shadowOrigin + ts * lightDir;
+            float shadowDiskR = glm::length(glm::vec2(shadowHit.x, shadowHit.z));
+            if (std::fabs(shadowHit.y) < stepSize &&
+                shadowDiskR > scene.diskInnerRadius && shadowDiskR < scene.diskOuterRadius) {
+                inShadow = true;
+            }
+        }
+    }
+    float shadowFactor = inShadow ? 0.05f : 1.0f;
+
+    //Specular highlight
+    glm::vec3 viewDir = glm::normalize(rayOrigin - pos);
+    glm::vec3 halfDir = glm::normalize(lightDir + viewDir);
+    float spec = std::pow(std::max(glm::dot(normal, halfDir), 0.0f), 32.0f);
+    spec = std::min(spec, 1.0f);
+
+    diskCol *= (0.3f + 0.7f * diffuse) * shadowFactor;
+    diskCol += glm::vec3(1.0f, 0.9f, 0.7f) * spec * 0.2f * shadowFactor;
+    diskCol += scene.diskColor * 0.5f;
+    return diskCol;
+}
+
+//Equirectangular planet surface with Lambertian shading
+static glm::vec3 shadePlanet(const TraceScene& scene, const TracePlanet& planet, const glm::vec3& pos) {
+    glm::vec3 normal = glm::normalize(pos - planet.position);
+    float u = 0.5f + std::atan2(normal.z, normal.x) / (2.0f * PI);
+    float v = 0.5f - std::asin(glm::clamp(normal.y, -1.0f, 1.0f)) / PI;
+
+    glm::vec3 planetCol = planet.color;
+    if (scene.assets && planet.texture >= 0 && planet.texture < static_cast<int>(scene.assets->planetTextures.size())) {
+        planetCol = glm::vec3(scene.assets->planetTextures[planet.texture].sample(glm::vec2(u, v)));
+    }
+
+    const glm::vec3 lightDir = glm::normalize(glm::vec3(0.3f, 1.0f, 0.3f));
+    float diffuse = std::max(glm::dot(normal, lightDir), 0.0f);
+    return planetCol * (0.3f + 0.7f * diffuse);
+}
+
+//----------------- Ray March -----------------
+static const int MAX_STEPS = 2000;
+static_assert(MAX_STEPS % CpuTracer::WAVEFRONT_CHUNK == 0, "Wavefront lanes reach the step limit on a chunk boundary");
+static const float STEP_SIZE = 0.1f;
+
+//Colour accumulated along one ray, shared by the scalar and packet paths
+struct RayShading {
+    glm::vec3 color = glm::vec3(0.0f);
+    bool hit = false;
+    int diskHits = 0;
+    glm::vec3 diskAccum = glm::vec3(0.0f);
+    int planet = -1;//Planet the ray stopped on
+    glm::vec3 horizon = glm::vec3(0.0f);//Where a captured ray crossed the horizon, seen from the hole
+};
+
+//What one camera ray came back with. Besides the colour, what it hit and where it looked,
+//the variable-rate pass compares those between neighbouring samples
+struct RaySample {
+    glm::vec3 color = glm::vec3(0.0f);
+    uint32_t kind = 0;//Disk crossings (bits 0-2), background (3-4), near photon sphere (5), planet (8+), as the G-buffer flags
+    glm::vec3 direction = glm::vec3(0.0f);//Lensed sky direction, planet normal, or where a captured ray crossed the horizon
+    float redshift = 1.0f;//Gravitational redshift of the sky
+};
+static const uint32_t SAMPLE_SKY = 1u << 3;
+static const uint32_t SAMPLE_PLANET = 2u << 3;
+static const uint32_t SAMPLE_NEAR_PHOTON_SPHERE = 32u;
+
+//Accumulate disk color, dimmer for higher-order images
+static void accumulateDisk(const TraceScene& scene, RayShading& shading, const glm::vec3& pos, const glm::vec3& dir, const glm::vec3& rayOrigin, float diskR) {
+    float weight = std::pow(0.5f, static_cast<float>(shading.diskHits));
+    shading.diskAccum += shadeDisk(scene, pos, dir, rayOrigin, diskR, STEP_SIZE) * weight;
+    shading.diskHits++;
+}
+
+//Lensed skybox with gravitational redshift
+static glm::vec3 skyColor(const TraceScene& scene, const glm::vec3& lensedDir, float gRedshift, bool nearPhotonSphere) {
+    glm::vec3 skyColor = scene.assets ? scene.assets->skybox.sample(lensedDir) : glm::vec3(0.0f);
+    skyColor = glm::mix(glm::vec3(skyColor.r, 0.0f, 0.0f), skyColor, gRedshift);
+
+    //Photon sphere highlight (only for escaping rays)
+    if (nearPhotonSphere) {
+        skyColor = glm::mix(skyColor, glm::vec3(5.0f, 5.0f, 1.5f), 0.2f);
+    }
+    return skyColor;
+}
+
+//Resolve the final colour once the ray has stopped (disk images, then lensed skybox)
+static RaySample finishRay(const TraceScene& scene, const RayShading& shading, const glm::vec3& pos, const glm::vec3& dir, bool nearPhotonSphere) {
+    RaySample sample;
+    sample.kind = static_cast<uint32_t>(std::min(shading.diskHits, 4)) | (nearPhotonSphere ? SAMPLE_NEAR_PHOTON_SPHERE : 0u);
+    if (shading.diskHits > 0) {
+        sample.color = shading.diskAccum;
+        return sample;
+    }
+    if (shading.hit) {
+        sample.color = shading.color;
+        if (shading.planet >= 0) {
+            sample.kind |= SAMPLE_PLANET | (static_cast<uint32_t>(shading.planet) << 8);
+            sample.direction = glm::normalize(pos - scene.planets[shading.planet].position);
+        }
+        else {
+            sample.direction = shading.horizon;
+        }
+        return sample;
+    }
+
+    sample.kind |= SAMPLE_SKY;
+    sample.direction = glm::normalize(dir);
+    sample.redshift = std::sqrt(glm::clamp(1.0f - scene.bhRadius / glm::length(pos), 0.0f, 1.0f));
+    sample.color = skyColor(scene, sample.direction, sample.redshift, nearPhotonSphere);
+    return sample;
+}
+
+//Distance to the nearest thing the march samples: photon sphere shell, disk annulus, planets
+//An adaptive step no longer than this can't jump over any of them
+static float featureDistance(const TraceScene& scene, const glm::vec3& pos, float r) {
+    float d = std::fabs(r - scene.bhRadius * 1.5f);
+
+    float diskR = glm::length(glm::vec2(pos.x, pos.z));
+    float radial = std::max(std::max(scene.diskInnerRadius - diskR, diskR - scene.diskOuterRadius), 0.0f);
+    d = std::min(d, std::sqrt(radial * radial + pos.y * pos.y));
+
+    return BodyBvh::nearestSurface(scene.planetTree, pos, d);
+}
+
+//Outbound past the disk and unable to reach any planet, even bending by the full escapeDeflection
+static bool canEscape(const TraceScene& scene, const glm::vec3& pos, const glm::vec3& dir, float r) {
+    if (glm::dot(pos, dir) <= 0.0f || r <= scene.diskOuterRadius) return false;
+
+    float delta = Physics::escapeDeflection(pos, dir, scene.bhRadius);
+    return !BodyBvh::any(scene.planetTree, [&](const glm::vec3& centre, float radius, const BodyBvh::Node* node) {
+        glm::vec3 oc = pos - centre;
+        float along = glm::dot(oc, dir);
+        float miss = glm::length(oc - along * dir);
+        //Any sphere inside a node's bounds is ahead of -radius and within radius + delta (ahead + radius) of the line
+        if (node) return along < radius && miss < radius + delta * (radius - along);
+        return along < 0.0f && miss < radius - delta * along;
+    });
+}
+
+//Colour of a ray its impact parameter settles on its own, false when it has to be marched
+//Mirrors resolveImpact() in geodesic.comp, the disk and planets must be out of reach of the whole path
+static bool resolveImpact(const TraceScene& scene, const glm::vec3& pos, const glm::vec3& dir, RaySample& sample) {
+    const float band = STEP_SIZE;//Disk slab half thickness the march tests against
+    float outer = std::sqrt(scene.diskOuterRadius * scene.diskOuterRadius + band * band);
+    ImpactSweep sweep;
+    RayFate fate = Physics::classifyImpact(pos, dir, scene.bhRadius, scene.integrator == IntegratorType::Binet, scene.diskInnerRadius, outer, sweep);
+    if (fate == RayFate::Ambiguous) return false;
+
+    //Disk: y = r (cos(phi) e1.y + sin(phi) e2.y) has to stay outside the slab while r is in the annulus
+    if (sweep.phiLeave >= sweep.phiEnter) {
+        if (sweep.phiLeave - sweep.phiEnter >= PI) return false;
+        float phiY = std::atan2(sweep.e2.y, sweep.e1.y);
+        //First node (y = 0) at or after phiEnter
+        float node = phiY + 0.5f * PI + PI * std::ceil((sweep.phiEnter - phiY - 0.5f * PI) / PI);
+        if (node <= sweep.phiLeave) return false;
+        float tilt = glm::length(glm::vec2(sweep.e1.y, sweep.e2.y));
+        float c = std::min(std::fabs(std::cos(sweep.phiEnter - phiY)), std::fabs(std::cos(sweep.phiLeave - phiY)));
+        if (scene.diskInnerRadius * tilt * c < band) return false;
+    }
+
+    if (fate == RayFate::Captured) {
+        //Inbound all the way, the path never leaves the start radius
+        float r0 = glm::length(pos);
+        if (BodyBvh::any(scene.planetTree, [&](const glm::vec3& centre, float radius, const BodyBvh::Node*) {
+                return glm::length(centre - scene.bhPosition) - radius < r0;
+            })) return false;
+        //Past the inner disk edge it's nearly at the horizon
+        sample = RaySample();
+        sample.direction = sweep.phiLeave >= sweep.phiEnter ? std::cos(sweep.phiLeave) * sweep.e1 + std::sin(sweep.phiLeave) * sweep.e2 : dir;
+        return true;
+    }
+
+    //The direction turns monotonically towards the asymptote, so the path reaches a point D away
+    //from the start within D tan(delta) of the straight line
+    glm::vec3 asymptote = std::cos(sweep.phiEscape) * sweep.e1 + std::sin(sweep.phiEscape) * sweep.e2;
+    float cosDelta = glm::dot(dir, asymptote);
+    if (cosDelta < 0.1f) return false;
+    float tanDelta = std::sqrt(1.0f - cosDelta * cosDelta) / cosDelta;
+    //Distance to the half line grows by at most as much as the centre moves, so a node's bounding sphere
+    //passes whenever a sphere inside it would
+    if (BodyBvh::any(scene.planetTree, [&](const glm::vec3& centre, float radius, const BodyBvh::Node*) {
+            glm::vec3 oc = centre - pos;
+            float along = std::max(glm::dot(oc, dir), 0.0f);
+            float miss = glm::length(oc - along * dir);
+            return miss < radius + (glm::length(oc) + radius) * tanDelta;
+        })) return false;
+
+    RayShading shading;
+    sample = finishRay(scene, shading, pos, asymptote, sweep.periapsis < scene.bhRadius * 1.6f);
+    return true;
+}
+
+//Whether the tabulated orbit could touch a sphere. It cuts the orbit plane in a circle of radius rho at distance d
+//from the hole, inside the wedge phiP +- asin(rho / d). The orbit misses it if it stays on one side of
+//[d - rho, d + rho] across the wedge (mirrors sphereOnOrbit() in geodesic.comp). A sphere's wedge covers
+//those of the spheres inside it, so node bounds are tested the same way
+static bool sphereOnOrbit(const TraceScene& scene, const DeflectionLut::Table& table, const DeflectionLut::Lookup& ray,
+                          const glm::vec3& normal, const glm::vec3& centre, float radius) {
+    glm::vec3 c = centre - scene.bhPosition;
+    float h = glm::dot(c, normal);
+    if (std::fabs(h) >= radius) return false;
+    float rho = std::sqrt(radius * radius - h * h);
+    float a = glm::dot(c, ray.e1), b = glm::dot(c, ray.e2);
+    float d = std::sqrt(a * a + b * b);
+    if (d <= rho) return true;
+
+    float halfWidth = std::asin(rho / d);
+    float phiP = std::atan2(b, a);
+    for (float center = phiP < 0.0f ? phiP : phiP - 2.0f * PI; center - halfWidth < ray.phiEnd; center += 2.0f * PI) {
+        if (center + halfWidth < 0.0f) continue;
+        bool below = false, above = false;
+        for (int i = 0; i < 5; ++i) {
+            float phi = glm::clamp(center + halfWidth * (0.5f * i - 1.0f), 0.0f, ray.phiEnd);
+            float u = DeflectionLut::sample(table, ray, phi).x;
+            if (u > 0.0f && 1.0f / u < d - rho) below = true;
+            else if (u <= 0.0f || 1.0f / u > d + rho) above = true;
+            else return true;
+        }
+        if (below && above) return true;
+    }
+    return false;
+}
+
+//Planets the tabulated orbit could touch (mirrors planetsOnOrbit() in geodesic.comp)
+static bool planetsOnOrbit(const TraceScene& scene, const DeflectionLut::Table& table, const DeflectionLut::Lookup& ray) {
+    glm::vec3 normal = glm::cross(ray.e1, ray.e2);
+    return BodyBvh::any(scene.planetTree, [&](const glm::vec3& centre, float radius, const BodyBvh::Node* node) {
+        //A node's box is often much thinner than its bounding sphere, both have to cut the orbit plane
+        if (node) {
+            glm::vec3 c = 0.5f * (node->boundsMin + node->boundsMax) - scene.bhPosition;
+            glm::vec3 halfSize = 0.5f * (node->boundsMax - node->boundsMin);
+            if (std::fabs(glm::dot(c, normal)) > glm::dot(halfSize, glm::abs(normal))) return false;
+        }
+        return sphereOnOrbit(scene, table, ray, normal, centre, radius);
+    });
+}
+
+//Colour of a camera ray read off the deflection table, false when it has to be marched
+//Mirrors lookupDeflection() in geodesic.comp
+static bool lookupDeflection(const TraceScene& scene, const DeflectionLut::Table& table, const glm::vec3& pos, const glm::vec3& dir, RaySample& sample) {
+    const float band = STEP_SIZE;
+    if (std::fabs(pos.y) < band && glm::length(glm::vec2(pos.x, pos.z)) < scene.diskOuterRadius) return false;
+
+    DeflectionLut::Lookup ray;
+    if (!DeflectionLut::lookup(table, pos, dir, ray)) return false;
+
+    if (planetsOnOrbit(scene, table, ray)) return false;
+
+    //Disk: the march shades every STEP_SIZE while |y| < band over the annulus, each sample half as bright as the last.
+    //y = r (cos(phi) e1.y + sin(phi) e2.y) vanishes at the nodes and the path can only be in the slab within
+    //band / (innerRadius tilt) of one. That wedge is swept in SLAB_SAMPLES steps, the first sample inside is shaded
+    //and stands in for the whole stretch, weighted by its length in march steps
+    const int SLAB_SAMPLES = 16;
+    RayShading shading;
+    float diskHits = 0.0f;
+    if (ray.rMin < scene.diskOuterRadius) {
+        float tilt = glm::length(glm::vec2(ray.e1.y, ray.e2.y));
+        float reach = band / (scene.diskInnerRadius * tilt);
+        if (reach > 0.5f) return false;//Skims the disk plane
+        float phiY = std::atan2(ray.e2.y, ray.e1.y);
+        float node = phiY + 0.5f * PI + PI * std::ceil((-reach - phiY - 0.5f * PI) / PI);
+        for (int k = 0; k < 5 && node - reach < ray.phiEnd; ++k, node += PI) {
+            float start = std::max(node - reach, 0.0f);
+            float dphi = (std::min(node + reach, ray.phiEnd) - start) / SLAB_SAMPLES;
+            float inside = 0.0f;
+            glm::vec3 hitPos, hitDir;
+            for (int i = 0; i < SLAB_SAMPLES; ++i) {
+                float phi = start + (i + 0.5f) * dphi;
+                glm::vec2 uw = DeflectionLut::sample(table, ray, phi);
+                if (uw.x <= 0.0f) break;
+                glm::vec3 radial = std::cos(phi) * ray.e1 + std::sin(phi) * ray.e2;
+                glm::vec3 p = radial / uw.x;
+                float diskR = glm::length(glm::vec2(p.x, p.z));
+                if (std::fabs(p.y) >= band || diskR <= scene.diskInnerRadius || diskR >= scene.diskOuterRadius) continue;
+
+                if (inside == 0.0f) {
+                    glm::vec3 tangential = std::cos(phi) * ray.e2 - std::sin(phi) * ray.e1;
+                    hitPos = p;
+                    hitDir = glm::normalize(-uw.y * radial + uw.x * tangential);
+                }
+                inside += dphi * std::sqrt(uw.x * uw.x + uw.y * uw.y) / (uw.x * uw.x);
+            }
+            if (inside == 0.0f) continue;
+
+            float marchSamples = inside / STEP_SIZE;
+            float weight = 2.0f * (1.0f - std::pow(0.5f, marchSamples)) * std::pow(0.5f, diskHits);
+            shading.diskAccum += shadeDisk(scene, hitPos, hitDir, pos, glm::length(glm::vec2(hitPos.x, hitPos.z)), STEP_SIZE) * weight;
+            shading.diskHits = 1;
+            diskHits += marchSamples;
+        }
+    }
+
+    shading.hit = ray.captured;
+    shading.horizon = ray.asymptote();
+    sample = finishRay(scene, shading, pos, ray.asymptote(), ray.rMin < scene.bhRadius * 1.6f);
+    return true;
+}
+
+//Trace a single camera ray, same control flow as main() in geodesic.comp
+static RaySample traceRay(const TraceScene& scene, const glm::vec3& rayOrigin, const glm::vec3& rayDir, uint64_t& steps) {
+    glm::vec3 pos = rayOrigin;
+    glm::vec3 dir = rayDir;
+    RayShading shading;
+    bool nearPhotonSphere = false;
+
+    //Adaptive integrator state
+    bool adaptive = scene.integrator == IntegratorType::DormandPrince;
+    glm::vec3 accel = Physics::schwarzschildAccel(pos, scene.bhRadius);
+    float h = STEP_SIZE;
+
+    //Orbital plane state, radial rays fall back to RK4
+    OrbitState orbit;
+    bool binet = scene.integrator == IntegratorType::Binet && Physics::orbitFromRay(pos, dir, orbit);
+
+    float photonSphereRadius = scene.bhRadius * 1.5f;
+    float photonSphereThickness = scene.bhRadius * 0.1f;
+
+    for (int i = 0; i < MAX_STEPS; ++i) {
+        float r = glm::length(pos);
+
+        //Event horizon
+        if (r < scene.bhRadius) {
+            shading.color = glm::vec3(0.0f);
+            shading.hit = true;
+            shading.horizon = pos / r;
+            break;
+        }
+
+        if (std::fabs(r - photonSphereRadius) < photonSphereThickness) {
+            nearPhotonSphere = true;
+        }
+
+        //Accretion disk intersection (XZ plane, y ~ 0)
+        if (std::fabs(pos.y) < STEP_SIZE) {
+            float diskR = glm::length(glm::vec2(pos.x, pos.z));
+            if (diskR > scene.diskInnerRadius && diskR < scene.diskOuterRadius) {
+                if (r > 100.0f) {
+                    break;
+                }
+                accumulateDisk(scene, shading, pos, dir, rayOrigin, diskR);
+            }
+        }
+
+        //Analytic escape, the rest of the bend in closed form
+        if (scene.analyticEscape && canEscape(scene, pos, dir, r)) {
+            dir = binet ? Physics::binetEscapeDirection(orbit, scene.bhRadius) : Physics::escapeDirection(pos, dir, scene.bhRadius);
+            break;
+        }
+
+        //Escape condition (sky)
+        if (r > 3000.0f) {
+            break;
+        }
+
+        glm::vec3 from = pos;
+        if (binet) {
+            Physics::binetStep(orbit, Physics::binetAngleStep(orbit, STEP_SIZE), scene.bhRadius);
+            if (orbit.u <= 0.0f) break;//Reached infinity, dir is already the asymptote
+            Physics::orbitToRay(orbit, pos, dir);
+            ++steps;
+        }
+        else if (adaptive) {
+            float maxStep = std::max(STEP_SIZE, featureDistance(scene, pos, r));
+            steps += Physics::dopri5Step(pos, dir, accel, h, maxStep, scene.bhRadius, scene.tolerance);
+        }
+        else {
+            Physics::rk4Step(pos, dir, STEP_SIZE, scene.bhRadius);
+            ++steps;
+        }
+
+        //Sphere intersection along the step, the ray stops where it went in
+        float t;
+        int planet = BodyBvh::firstHit(scene.planetTree, from, pos, t);
+        if (planet >= 0) {
+            pos = from + t * (pos - from);
+            shading.color = shadePlanet(scene, scene.planets[planet], pos);
+            shading.hit = true;
+            shading.planet = planet;
+            break;
+        }
+    }
+
+    return finishRay(scene, shading, pos, dir, nearPhotonSphere);
+}
+
+//Run the SIMD kernel until every lane has stopped for good or on params.maxSteps
+//The kernel stops a lane on every event, the event is shaded here and the lane resumed
+static void advancePacket(const TraceScene& scene, const PacketParams& params, PacketIsa isa, RayPacket& packet, RayShading* shading, uint64_t& steps) {
+    for (;;) {
+        steps += RayPackets::advance(isa, packet, params);
+
+        bool resumed = false;
+        for (int i = 0; i < PACKET_LANES; ++i) {
+            glm::vec3 pos(packet.px[i], packet.py[i], packet.pz[i]);
+            glm::vec3 dir(packet.dx[i], packet.dy[i], packet.dz[i]);
+            switch (packet.status[i]) {
+            case LANE_DISK: {
+                if (glm::length(pos) > 100.0f) {
+                    packet.status[i] = LANE_ESCAPED;
+                    break;
+                }
+                accumulateDisk(scene, shading[i], pos, dir, scene.camPos, glm::length(glm::vec2(pos.x, pos.z)));
+                packet.flags[i] |= LANE_SKIP_DISK;
+                packet.status[i] = LANE_ACTIVE;
+                resumed = true;
+                break;
+            }
+            case LANE_PLANET:
+                shading[i].color = shadePlanet(scene, scene.planets[packet.planet[i]], pos);
+                shading[i].hit = true;
+                shading[i].planet = packet.planet[i];
+                break;
+            case LANE_CAPTURED:
+                shading[i].color = glm::vec3(0.0f);
+                shading[i].hit = true;
+                shading[i].horizon = glm::normalize(pos);
+                break;
+            case LANE_ESCAPED:
+                if (packet.flags[i] & LANE_ANALYTIC_ESCAPE) {
+                    dir = Physics::escapeDirection(pos, dir, scene.bhRadius);
+                    packet.dx[i] = dir.x;
+                    packet.dy[i] = dir.y;
+                    packet.dz[i] = dir.z;
+                    packet.flags[i] &= ~LANE_ANALYTIC_ESCAPE;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        if (!resumed) break;
+    }
+}
+
+//Put a camera ray into a lane, steps is where the lane's step count starts
+static void startLane(RayPacket& packet, int lane, const glm::vec3& origin, const glm::vec3& dir, int steps) {
+    packet.px[lane] = origin.x;
+    packet.py[lane] = origin.y;
+    packet.pz[lane] = origin.z;
+    packet.dx[lane] = dir.x;
+    packet.dy[lane] = dir.y;
+    packet.dz[lane] = dir.z;
+    packet.status[lane] = LANE_ACTIVE;
+    packet.steps[lane] = steps;
+    packet.planet[lane] = -1;
+    packet.flags[lane] = 0;
+}
+
+//Trace up to PACKET_LANES rays together with the SIMD kernel
+static void tracePacket(const TraceScene& scene, const PacketParams& params, PacketIsa isa, RayPacket& packet, int lanes, RaySample* samples, uint64_t& steps) {
+    RayShading shading[PACKET_LANES];
+    advancePacket(scene, params, isa, packet, shading, steps);
+
+    for (int i = 0; i < lanes; ++i) {
+        glm::vec3 pos(packet.px[i], packet.py[i], packet.pz[i]);
+        glm::vec3 dir(packet.dx[i], packet.dy[i], packet.dz[i]);
+        samples[i] = finishRay(scene, shading[i], pos, dir, (packet.flags[i] & LANE_NEAR_PHOTON_SPHERE) != 0);
+    }
+}
+
+//----------------- Variable Rate -----------------
+//Corners further apart than this many times the camera's own spread across the cell are on a lensed edge
+static const float EDGE_BEND = 2.0f;
+//Planet normals and colours further apart than these between corners
+static const float EDGE_NORMAL = 0.3f;
+static const float EDGE_COLOR = 0.25f;
+
+//Whether a cell's four corner samples (00, 10, 01, 11) can stand in for the pixels between them: the same hit
+//everywhere, a sky bent no more than EDGE_BEND times the camera's spread from corner 00 to 11 (cosSpread), and
+//for disk and planet pixels, whose colour is filled in directly, no sharp change of colour
+static bool cellIsSmooth(const RaySample* const corners[4], float cosSpread) {
+    uint32_t kind = corners[0]->kind;
+    for (int i = 1; i < 4; ++i) {
+        if (corners[i]->kind != kind) return false;
+    }
+    //Sky or horizon on both sides of the disk plane: the rays between may cross it in the annulus, seeing a disk
+    //too thin to reach any corner when it's edge-on
+    if ((kind & 7u) == 0u && (kind & (3u << 3)) != SAMPLE_PLANET) {
+        bool above = corners[0]->direction.y > 0.0f;
+        for (int i = 1; i < 4; ++i) {
+            if ((corners[i]->direction.y > 0.0f) != above) return false;
+        }
+    }
+    bool sky = (kind & 7u) == 0u && (kind & (3u << 3)) == SAMPLE_SKY;
+    if (sky) {
+        float cosBend = std::cos(EDGE_BEND * std::acos(glm::clamp(cosSpread, -1.0f, 1.0f)));
+        return glm::dot(corners[0]->direction, corners[3]->direction) >= cosBend
+            && glm::dot(corners[1]->direction, corners[2]->direction) >= cosBend;
+    }
+    if ((kind & (3u << 3)) == SAMPLE_PLANET && (kind & 7u) == 0u) {
+        float cosNormal = std::cos(EDGE_NORMAL);
+        if (glm::dot(corners[0]->direction, corners[3]->direction) < cosNormal
+            || glm::dot(corners[1]->direction, corners[2]->direction) < cosNormal) return false;
+    }
+    for (int i = 1; i < 4; ++i) {
+        glm::vec3 a = corners[0]->color, b = corners[i]->color;
+        float scale = std::max(std::max(std::max(a.r, a.g), a.b), std::max(std::max(b.r, b.g), b.b));
+        glm::vec3 d = glm::abs(a - b);
+        if (std::max(std::max(d.r, d.g), d.b) > EDGE_COLOR * scale + 0.02f) return false;
+    }
+    return true;
+}
+
+//Sample at (fx, fy) across a smooth cell. The sky is re-shaded along the interpolated direction so stars
+//between the corners stay sharp, everything else takes the blended colour
+static RaySample fillSample(const TraceScene& scene, const RaySample* const corners[4], float fx, float fy) {
+    float w[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+    RaySample sample;
+    sample.kind = corners[0]->kind;
+    for (int i = 0; i < 4; ++i) {
+        sample.color += corners[i]->color * w[i];
+        sample.direction += corners[i]->direction * w[i];
+        sample.redshift += (corners[i]->redshift - 1.0f) * w[i];
+    }
+    if ((sample.kind & 7u) == 0u && (sample.kind & (3u << 3)) == SAMPLE_SKY) {
+        sample.direction = glm::normalize(sample.direction);
+        sample.color = skyColor(scene, sample.direction, sample.redshift, (sample.kind & SAMPLE_NEAR_PHOTON_SPHERE) != 0u);
+    }
+    return sample;
+}
+
+//----------------- CPU Tracer -----------------
+CpuTracer::CpuTracer(unsigned threadCount)
+    : m_scheduler(threadCount), m_usePackets(true), m_isa(RayPackets::detectIsa())
+{
+}
+
+TraceStats CpuTracer::render(const TraceScene& frameScene, int width, int height, float* rgba) {
+    TraceStats stats;
+    stats.threads = m_scheduler.threadCount();
+    auto start = std::chrono::steady_clock::now();
+
+    std::atomic<uint64_t> totalSteps(0);
+    std::atomic<uint64_t> totalResolved(0);
+    std::atomic<uint64_t> totalTable(0);
+    std::atomic<uint64_t> totalPacketSteps(0);
+    std::atomic<uint64_t> totalIssuedSteps(0);
+    glm::vec2 resolution(static_cast<float>(width), static_cast<float>(height));
+    int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+    //The planets move from frame to frame, so their hierarchy is rebuilt like the Renderer's
+    TraceScene scene = frameScene;
+    scene.planetTree.spheres.clear();
+    for (const TracePlanet& planet : scene.planets) {
+        scene.planetTree.spheres.push_back(glm::vec4(planet.position, planet.radius));
+    }
+    BodyBvh::build(scene.planetTree);
+
+    PacketParams params;
+    params.rs = scene.bhRadius;
+    params.stepSize = STEP_SIZE;
+    params.diskBand = STEP_SIZE;
+    params.diskInnerRadius = scene.diskInnerRadius;
+    params.diskOuterRadius = scene.diskOuterRadius;
+    PacketPlanetArrays planetArrays;
+    params.planets = RayPackets::flattenPlanets(scene.planetTree, planetArrays);
+    params.maxSteps = MAX_STEPS;
+    params.analyticEscape = scene.analyticEscape;
+
+    //First pass, same table as deflectionLut.comp
+    DeflectionLut::Table table;
+    if (scene.deflectionLut) {
+        float maxAngle = DeflectionLut::maxAngle(scene.invView, scene.invProj, scene.camPos, scene.bhPosition);
+        float camRadius = glm::length(scene.camPos - scene.bhPosition);
+        bool binet = scene.integrator == IntegratorType::Binet;
+        if (!scene.atlas || !DeflectionLut::resample(*scene.atlas, scene.bhRadius, camRadius, maxAngle, binet, table)) {
+            DeflectionLut::build(scene.bhRadius, camRadius, maxAngle, binet, table);
+        }
+    }
+
+    //Variable rate keeps the coarse grid's samples for the edge test, one per grid point
+    const int STEP = VARIABLE_RATE_STEP;
+    int gridX = (width + STEP - 2) / STEP + 1, gridY = (height + STEP - 2) / STEP + 1;
+    std::vector<RaySample> grid;
+    if (scene.variableRate) {
+        grid.resize(static_cast<size_t>(gridX) * gridY);
+    }
+    auto onGrid = [&](int v, int size) { return v % STEP == 0 || v == size - 1; };
+    auto gridIndex = [&](int x, int y) { return static_cast<size_t>((y + STEP - 1) / STEP) * gridX + (x + STEP - 1) / STEP; };
+
+    auto store = [&](int x, int y, const RaySample& sample) {
+        float* out = rgba + (static_cast<size_t>(y) * width + x) * 4;
+        out[0] = sample.color.r;
+        out[1] = sample.color.g;
+        out[2] = sample.color.b;
+        out[3] = 1.0f;
+        if (!grid.empty() && onGrid(x, width) && onGrid(y, height)) {
+            grid[gridIndex(x, y)] = sample;
+        }
+    };
+
+    //Trace up to one tile's worth of listed pixels
+    std::atomic<uint64_t> totalRays(0);
+    auto tracePixels = [&](const int* pixelX, const int* pixelY, int n) {
+        uint64_t steps = 0, resolved = 0, fromTable = 0;
+        totalRays.fetch_add(n, std::memory_order_relaxed);
+
+        //Deflection table and impact parameter pre-passes, the rays they can't settle are collected for the integrator
+        int pendingX[TILE_SIZE * TILE_SIZE], pendingY[TILE_SIZE * TILE_SIZE];
+        glm::vec3 pendingDir[TILE_SIZE * TILE_SIZE];
+        int count = 0;
+        for (int p = 0; p < n; ++p) {
+            int x = pixelX[p], y = pixelY[p];
+            glm::vec3 dir = Physics::generateRay(scene.invView, scene.invProj, glm::vec2(x + 0.5f, y + 0.5f), resolution);
+            RaySample sample;
+            if (scene.deflectionLut && lookupDeflection(scene, table, scene.camPos, dir, sample)) {
+                store(x, y, sample);
+                ++fromTable;
+                continue;
+            }
+            if (scene.classifyRays && resolveImpact(scene, scene.camPos, dir, sample)) {
+                store(x, y, sample);
+                ++resolved;
+                continue;
+            }
+            pendingX[count] = x;
+            pendingY[count] = y;
+            pendingDir[count] = dir;
+            ++count;
+        }
+        totalResolved.fetch_add(resolved, std::memory_order_relaxed);
+        totalTable.fetch_add(fromTable, std::memory_order_relaxed);
+
+        if (!m_usePackets || scene.integrator != IntegratorType::RK4) {
+            for (int i = 0; i < count; ++i) {
+                store(pendingX[i], pendingY[i], traceRay(scene, scene.camPos, pendingDir[i], steps));
+            }
+            totalSteps.fetch_add(steps, std::memory_order_relaxed);
+            return;
+        }
+
+        uint64_t packetSteps = 0, issuedSteps = 0;
+        if (m_wavefront) {
+            //The tile's remaining rays are this worker's queue for one packet. Every WAVEFRONT_CHUNK steps the lanes
+            //whose rays stopped are finished and take the next rays, the rest carry on. A lane's steps start at the
+            //chunk it joined in, so its step limit falls on a chunk boundary
+            RayPacket packet;
+            RayShading shading[PACKET_LANES];
+            int laneRay[PACKET_LANES];
+            int laneStart[PACKET_LANES];
+            //Idle lanes are still loaded and stepped by the SIMD kernel, give them a valid ray like the padding below
+            for (int i = 0; i < PACKET_LANES; ++i) {
+                startLane(packet, i, scene.camPos, glm::vec3(0.0f, 0.0f, 1.0f), 0);
+                packet.status[i] = LANE_DONE;
+                laneRay[i] = -1;
+            }
+            PacketParams chunkParams = params;
+            int next = 0;
+            for (int chunk = 0; ; ++chunk) {
+                int busy = 0;
+                for (int i = 0; i < PACKET_LANES; ++i) {
+                    if (laneRay[i] < 0 && next < count) {
+                        laneRay[i] = next++;
+                        laneStart[i] = chunk * WAVEFRONT_CHUNK;
+                        startLane(packet, i, scene.camPos, pendingDir[laneRay[i]], laneStart[i]);
+                        shading[i] = RayShading();
+                    }
+                    if (laneRay[i] >= 0) ++busy;
+                }
+                if (busy == 0) break;
+
+                chunkParams.maxSteps = (chunk + 1) * WAVEFRONT_CHUNK;
+                advancePacket(scene, chunkParams, m_isa, packet, shading, packetSteps);
+                for (int i = 0; i < PACKET_LANES; ++i) {
+                    if (laneRay[i] < 0) continue;
+                    if (packet.status[i] == LANE_STEP_LIMIT && packet.steps[i] - laneStart[i] < MAX_STEPS) {
+                        packet.status[i] = LANE_ACTIVE;
+                        continue;
+                    }
+                    glm::vec3 pos(packet.px[i], packet.py[i], packet.pz[i]);
+                    glm::vec3 dir(packet.dx[i], packet.dy[i], packet.dz[i]);
+                    store(pendingX[laneRay[i]], pendingY[laneRay[i]],
+                          finishRay(scene, shading[i], pos, dir, (packet.flags[i] & LANE_NEAR_PHOTON_SPHERE) != 0));
+                    packet.status[i] = LANE_DONE;
+                    laneRay[i] = -1;
+                }
+            }
+            issuedSteps = packet.issuedSteps;
+        }
+        else {
+            //Remaining rays of the 8x8 tile, 16 lanes per packet
+            for (int first = 0; first < count; first += PACKET_LANES) {
+                RayPacket packet;
+                int lanes = std::min(PACKET_LANES, count - first);
+                for (int i = 0; i < PACKET_LANES; ++i) {
+                    startLane(packet, i, scene.camPos, i < lanes ? pendingDir[first + i] : glm::vec3(0.0f, 0.0f, 1.0f), 0);
+                    if (i >= lanes) packet.status[i] = LANE_DONE;
+                }
+
+                RaySample samples[PACKET_LANES];
+                tracePacket(scene, params, m_isa, packet, lanes, samples, packetSteps);
+                for (int i = 0; i < lanes; ++i) {
+                    store(pendingX[first + i], pendingY[first + i], samples[i]);
+                }
+                issuedSteps += packet.issuedSteps;
+            }
+        }
+        totalPacketSteps.fetch_add(packetSteps, std::memory_order_relaxed);
+        totalIssuedSteps.fetch_add(issuedSteps, std::memory_order_relaxed);
+        totalSteps.fetch_add(steps + packetSteps, std::memory_order_relaxed);
+    };
+
+    //Every pixel of the tile, or in variable rate only the coarse grid's
+    m_scheduler.run(tilesX, tilesY, [&](int tx, int ty, unsigned) {
+        int pixelX[TILE_SIZE * TILE_SIZE], pixelY[TILE_SIZE * TILE_SIZE];
+        int n = 0;
+        for (int y = ty * TILE_SIZE; y < std::min((ty + 1) * TILE_SIZE, height); ++y) {
+            for (int x = tx * TILE_SIZE; x < std::min((tx + 1) * TILE_SIZE, width); ++x) {
+                if (scene.variableRate && !(onGrid(x, width) && onGrid(y, height))) continue;
+                pixelX[n] = x;
+                pixelY[n] = y;
+                ++n;
+            }
+        }
+        tracePixels(pixelX, pixelY, n);
+    });
+
+    //Variable rate refinement, per STEP x STEP cell of the grid: where the corners agree the pixels between them
+    //are filled in from them, the rest of the cell is traced. A cell owns its pixels up to the next one's corners
+    std::atomic<uint64_t> totalFilled(0);
+    if (scene.variableRate) {
+        m_scheduler.run(tilesX, tilesY, [&](int tx, int ty, unsigned) {
+            int pixelX[TILE_SIZE * TILE_SIZE], pixelY[TILE_SIZE * TILE_SIZE];
+            int n = 0;
+            uint64_t filled = 0;
+            for (int cy0 = ty * TILE_SIZE; cy0 < std::min((ty + 1) * TILE_SIZE, height); cy0 += STEP) {
+                for (int cx0 = tx * TILE_SIZE; cx0 < std::min((tx + 1) * TILE_SIZE, width); cx0 += STEP) {
+                    int cx1 = std::min(cx0 + STEP, width - 1), cy1 = std::min(cy0 + STEP, height - 1);
+                    const RaySample* corners[4] = { &grid[gridIndex(cx0, cy0)], &grid[gridIndex(cx1, cy0)],
+                                                    &grid[gridIndex(cx0, cy1)], &grid[gridIndex(cx1, cy1)] };
+                    glm::vec3 ray00 = Physics::generateRay(scene.invView, scene.invProj, glm::vec2(cx0 + 0.5f, cy0 + 0.5f), resolution);
+                    glm::vec3 ray11 = Physics::generateRay(scene.invView, scene.invProj, glm::vec2(cx1 + 0.5f, cy1 + 0.5f), resolution);
+                    bool smooth = cellIsSmooth(corners, glm::dot(ray00, ray11));
+
+                    for (int y = cy0; y < std::min(cy0 + STEP, height); ++y) {
+                        for (int x = cx0; x < std::min(cx0 + STEP, width); ++x) {
+                            if (onGrid(x, width) && onGrid(y, height)) continue;
+                            if (!smooth) {
+                                pixelX[n] = x;
+                                pixelY[n] = y;
+                                ++n;
+                                continue;
+                            }
+                            float fx = cx1 > cx0 ? static_cast<float>(x - cx0) / (cx1 - cx0) : 0.0f;
+                            float fy = cy1 > cy0 ? static_cast<float>(y - cy0) / (cy1 - cy0) : 0.0f;
+                            store(x, y, fillSample(scene, corners, fx, fy));
+                            ++filled;
+                        }
+                    }
+                }
+            }
+            totalFilled.fetch_add(filled, std::memory_order_relaxed);
+            tracePixels(pixelX, pixelY, n);
+        });
+    }
+
+    stats.rays = totalRays.load();
+    stats.filledPixels = totalFilled.load();
+    stats.steps = totalSteps.load();
+    stats.resolvedRays = totalResolved.load();
+    stats.tableRays = totalTable.load();
+    stats.packetSteps = totalPacketSteps.load();
+    stats.packetIssuedSteps = totalIssuedSteps.load();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,129 @@
+/*
+	Planet textures
+	Packs planet surfaces of any size into the layers of one texture array and uploads the new ones
+*/
+
+#include "../headers/planetTextures.hpp"
+#include "../headers/glHelpers.hpp"
+#include <stb_image.h>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+//----------------- Packing -----------------
+//2x2 box filter, an odd last row or column is averaged with itself
+static std::vector<unsigned char> halve(const std::vector<unsigned char>& src, int width, int height, int& outWidth, int& outHeight) {
+    outWidth = std::max(width / 2, 1);
+    outHeight = std::max(height / 2, 1);
+    std::vector<unsigned char> dst(static_cast<size_t>(outWidth) * outHeight * 4);
+    for (int y = 0; y < outHeight; ++y) {
+        int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < outWidth; ++x) {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (int c = 0; c < 4; ++c) {
+                int sum = src[(static_cast<size_t>(y0) * width + x0) * 4 + c] + src[(static_cast<size_t>(y0) * width + x1) * 4 + c]
+                        + src[(static_cast<size_t>(y1) * width + x0) * 4 + c] + src[(static_cast<size_t>(y1) * width + x1) * 4 + c];
+                dst[(static_cast<size_t>(y) * outWidth + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+            }
+        }
+    }
+    return dst;
+}
+
+//Bilinear resample to the layer size, longitude wraps and latitude clamps like the equirectangular lookup
+static std::vector<unsigned char> resample(const std::vector<unsigned char>& src, int width, int height) {
+    const int W = PlanetTextureArray::LAYER_WIDTH, H = PlanetTextureArray::LAYER_HEIGHT;
+    std::vector<unsigned char> dst(static_cast<size_t>(W) * H * 4);
+    for (int y = 0; y < H; ++y) {
+        float fy = (y + 0.5f) * height / H - 0.5f;
+        int y0 = static_cast<int>(std::floor(fy));
+        float ty = fy - y0;
+        int ya = std::min(std::max(y0, 0), height - 1), yb = std::min(std::max(y0 + 1, 0), height - 1);
+        for (int x = 0; x < W; ++x) {
+            float fx = (x + 0.5f) * width / W - 0.5f;
+            int x0 = static_cast<int>(std::floor(fx));
+            float tx = fx - x0;
+            int xa = (x0 % width + width) % width, xb = (x0 + 1) % width;
+            for (int c = 0; c < 4; ++c) {
+                float top = src[(static_cast<size_t>(ya) * width + xa) * 4 + c] * (1.0f - tx) + src[(static_cast<size_t>(ya) * width + xb) * 4 + c] * tx;
+                float bottom = src[(static_cast<size_t>(yb) * width + xa) * 4 + c] * (1.0f - tx) + src[(static_cast<size_t>(yb) * width + xb) * 4 + c] * tx;
+                dst[(static_cast<size_t>(y) * W + x) * 4 + c] = static_cast<unsigned char>(top * (1.0f - ty) + bottom * ty + 0.5f);
+            }
+        }
+    }
+    return dst;
+}
+
+int PlanetTextureArray::layer(const std::string& path) {
+    auto found = m_layers.find(path);
+    if (found != m_layers.end()) return found->second;
+
+    int width, height, channels;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (!data) throw std::runtime_error("Failed to load texture: " + path);
+    std::vector<unsigned char> pixels(data, data + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(data);
+
+    //Box filter large sources down first, bilinear alone would skip texels
+    while (width >= 2 * LAYER_WIDTH && height >= 2 * LAYER_HEIGHT) {
+        pixels = halve(pixels, width, height, width, height);
+    }
+
+    PendingLayer pending;
+    pending.layer = static_cast<int>(m_layers.size());
+    pending.mips.push_back(width == LAYER_WIDTH && height == LAYER_HEIGHT ? pixels : resample(pixels, width, height));
+    int mipWidth = LAYER_WIDTH, mipHeight = LAYER_HEIGHT;
+    for (int level = 1; level < MIP_LEVELS; ++level) {
+        pending.mips.push_back(halve(pending.mips.back(), mipWidth, mipHeight, mipWidth, mipHeight));
+    }
+    int index = pending.layer;
+    m_pending.push_back(std::move(pending));
+    m_layers[path] = index;
+    return index;
+}
+
+//----------------- Upload -----------------
+void PlanetTextureArray::upload() {
+    m_uploaded = 0;
+    if (m_pending.empty()) return;
+
+    //Immutable storage can't grow, a larger array takes over the uploaded layers on the GPU
+    if (layerCount() > m_capacity) {
+        int capacity = std::max(m_capacity * 2, 4);
+        while (capacity < layerCount()) capacity *= 2;
+        GLuint texture;
+        glGenTextures(1, &texture);
+        GLState::bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, MIP_LEVELS, GL_RGBA8, LAYER_WIDTH, LAYER_HEIGHT, capacity);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        int copied = layerCount() - static_cast<int>(m_pending.size());
+        if (m_texture != 0 && copied > 0) {
+            for (int level = 0; level < MIP_LEVELS; ++level) {
+                glCopyImageSubData(m_texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                    std::max(LAYER_WIDTH >> level, 1), std::max(LAYER_HEIGHT >> level, 1), copied);
+            }
+        }
+        GLState::deleteTexture(m_texture);
+        m_texture = texture;
+        m_capacity = capacity;
+    }
+
+    GLState::bindTexture(0, GL_TEXTURE_2D_ARRAY, m_texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const PendingLayer& pending : m_pending) {
+        for (int level = 0; level < MIP_LEVELS; ++level) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, pending.layer, std::max(LAYER_WIDTH >> level, 1),
+                std::max(LAYER_HEIGHT >> level, 1), 1, GL_RGBA, GL_UNSIGNED_BYTE, pending.mips[level].data());
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    m_uploaded = static_cast<int>(m_pending.size());
+    m_pending.clear();
+}
+
+PlanetTextureArray::~PlanetTextureArray() {
+    glDeleteTextures(1, &m_texture);
+}
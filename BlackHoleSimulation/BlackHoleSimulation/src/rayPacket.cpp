@@ -0,0 +1,134 @@
+/*
+	Ray packet kernel: scalar fallback and runtime ISA dispatch
+	The AVX2 and AVX-512 kernels live in their own translation units so only
+	they are compiled with the wider instruction sets
+*/
+
+#include "../headers/rayPacket.hpp"
+#include "../headers/bodyBvh.hpp"
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//----------------- Scalar lanes -----------------
+//One-lane stand-ins for the SIMD types so the scalar path runs the same kernel
+namespace {
+    struct Vf {
+        static const int WIDTH = 1;
+        float v;
+
+        static Vf load(const float* p) { return { *p }; }
+        static Vf set1(float x) { return { x }; }
+        void store(float* p) const { *p = v; }
+    };
+
+    struct Vm {
+        bool m;
+    };
+
+    inline Vf operator+(Vf a, Vf b) { return { a.v + b.v }; }
+    inline Vf operator-(Vf a, Vf b) { return { a.v - b.v }; }
+    inline Vf operator*(Vf a, Vf b) { return { a.v * b.v }; }
+    inline Vf operator/(Vf a, Vf b) { return { a.v / b.v }; }
+    inline Vm operator<(Vf a, Vf b) { return { a.v < b.v }; }
+    inline Vm operator>(Vf a, Vf b) { return { a.v > b.v }; }
+    inline Vm operator&(Vm a, Vm b) { return { a.m && b.m }; }
+    inline Vm operator|(Vm a, Vm b) { return { a.m || b.m }; }
+    inline Vm andNot(Vm a, Vm b) { return { !a.m && b.m }; }//~a & b
+    inline Vf vsqrt(Vf a) { return { std::sqrt(a.v) }; }
+    inline Vf vabs(Vf a) { return { std::fabs(a.v) }; }
+    inline Vf select(Vm m, Vf a, Vf b) { return m.m ? a : b; }
+    inline unsigned maskBits(Vm m) { return m.m ? 1u : 0u; }
+    inline Vm maskFromBits(unsigned bits) { return { (bits & 1u) != 0 }; }
+}
+
+#include "../headers/packetKernel.hpp"
+
+uint64_t RayPackets::advanceScalar(RayPacket& packet, const PacketParams& params) {
+    uint64_t steps = 0;
+    for (int lane = 0; lane < PACKET_LANES; ++lane) {
+        steps += PacketKernel::advanceLanes<Vf, Vm>(packet, lane, params);
+    }
+    return steps;
+}
+
+//----------------- Planets -----------------
+static_assert(PacketKernel::BVH_STACK == BodyBvh::MAX_DEPTH, "The kernel's traversal stack must match the hierarchy's depth limit");
+
+PacketPlanets RayPackets::flattenPlanets(const BodyBvh::Tree& tree, PacketPlanetArrays& arrays) {
+    arrays = PacketPlanetArrays();
+    for (const glm::vec4& s : tree.spheres) {
+        arrays.spheres.insert(arrays.spheres.end(), { s.x, s.y, s.z, s.w });
+    }
+    for (const BodyBvh::Node& node : tree.nodes) {
+        glm::vec4 bound = BodyBvh::boundingSphere(node);
+        arrays.nodeBounds.insert(arrays.nodeBounds.end(), { node.boundsMin.x, node.boundsMin.y, node.boundsMin.z,
+            node.boundsMax.x, node.boundsMax.y, node.boundsMax.z });
+        arrays.nodeSpheres.insert(arrays.nodeSpheres.end(), { bound.x, bound.y, bound.z, bound.w });
+        arrays.nodeFirst.push_back(node.first);
+        arrays.nodeCount.push_back(node.count);
+    }
+    arrays.indices = tree.indices;
+
+    PacketPlanets planets;
+    planets.spheres = arrays.spheres.data();
+    planets.nodeBounds = arrays.nodeBounds.data();
+    planets.nodeSpheres = arrays.nodeSpheres.data();
+    planets.nodeFirst = arrays.nodeFirst.data();
+    planets.nodeCount = arrays.nodeCount.data();
+    planets.indices = arrays.indices.data();
+    planets.bodies = static_cast<int>(tree.spheres.size());
+    return planets;
+}
+
+//----------------- Dispatch -----------------
+PacketIsa RayPackets::detectIsa() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return PacketIsa::Scalar;
+
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    if (!osxsave) return PacketIsa::Scalar;
+
+	//The OS has to save the YMM (and for AVX-512 the ZMM/opmask) state
+    unsigned long long xcr0 = _xgetbv(0);
+    bool ymm = (xcr0 & 0x6) == 0x6;
+    bool zmm = (xcr0 & 0xE6) == 0xE6;
+
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    bool avx512f = (info[1] & (1 << 16)) != 0;
+
+    if (avx512f && zmm) return PacketIsa::AVX512;
+    if (avx2 && fma && ymm) return PacketIsa::AVX2;
+    return PacketIsa::Scalar;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return PacketIsa::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return PacketIsa::AVX2;
+    return PacketIsa::Scalar;
+#else
+    return PacketIsa::Scalar;
+#endif
+}
+
+const char* RayPackets::isaName(PacketIsa isa) {
+    switch (isa) {
+    case PacketIsa::AVX512: return "AVX-512";
+    case PacketIsa::AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
+
+uint64_t RayPackets::advance(PacketIsa isa, RayPacket& packet, const PacketParams& params) {
+    switch (isa) {
+    case PacketIsa::AVX512: return advanceAvx512(packet, params);
+    case PacketIsa::AVX2: return advanceAvx2(packet, params);
+    default: return advanceScalar(packet, params);
+    }
+}
@@ -0,0 +1,52 @@
+/*
+	AVX2 ray packet kernel (8 lanes)
+	Compiled with AVX2 + FMA enabled, only called after RayPackets::detectIsa()
+*/
+
+#include "../headers/rayPacket.hpp"
+#include <immintrin.h>
+
+//----------------- AVX2 lanes -----------------
+namespace {
+    struct Vf {
+        static const int WIDTH = 8;
+        __m256 v;
+
+        static Vf load(const float* p) { return { _mm256_loadu_ps(p) }; }
+        static Vf set1(float x) { return { _mm256_set1_ps(x) }; }
+        void store(float* p) const { _mm256_storeu_ps(p, v); }
+    };
+
+    struct Vm {
+        __m256 m;
+    };
+
+    inline Vf operator+(Vf a, Vf b) { return { _mm256_add_ps(a.v, b.v) }; }
+    inline Vf operator-(Vf a, Vf b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    inline Vf operator*(Vf a, Vf b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    inline Vf operator/(Vf a, Vf b) { return { _mm256_div_ps(a.v, b.v) }; }
+    inline Vm operator<(Vf a, Vf b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Vm operator>(Vf a, Vf b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Vm operator&(Vm a, Vm b) { return { _mm256_and_ps(a.m, b.m) }; }
+    inline Vm operator|(Vm a, Vm b) { return { _mm256_or_ps(a.m, b.m) }; }
+    inline Vm andNot(Vm a, Vm b) { return { _mm256_andnot_ps(a.m, b.m) }; }//~a & b
+    inline Vf vsqrt(Vf a) { return { _mm256_sqrt_ps(a.v) }; }
+    inline Vf vabs(Vf a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+    inline Vf select(Vm m, Vf a, Vf b) { return { _mm256_blendv_ps(b.v, a.v, m.m) }; }
+    inline unsigned maskBits(Vm m) { return static_cast<unsigned>(_mm256_movemask_ps(m.m)); }
+    inline Vm maskFromBits(unsigned bits) {
+        const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i b = _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(bits)), lanes);
+        return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(b, lanes)) };
+    }
+}
+
+#include "../headers/packetKernel.hpp"
+
+uint64_t RayPackets::advanceAvx2(RayPacket& packet, const PacketParams& params) {
+    uint64_t steps = 0;
+    for (int lane = 0; lane < PACKET_LANES; lane += Vf::WIDTH) {
+        steps += PacketKernel::advanceLanes<Vf, Vm>(packet, lane, params);
+    }
+    return steps;
+}
@@ -0,0 +1,44 @@
+/*
+	AVX-512 ray packet kernel (16 lanes)
+	Compiled with AVX-512F enabled, only called after RayPackets::detectIsa()
+*/
+
+#include "../headers/rayPacket.hpp"
+#include <immintrin.h>
+
+//----------------- AVX-512 lanes -----------------
+namespace {
+    struct Vf {
+        static const int WIDTH = 16;
+        __m512 v;
+
+        static Vf load(const float* p) { return { _mm512_loadu_ps(p) }; }
+        static Vf set1(float x) { return { _mm512_set1_ps(x) }; }
+        void store(float* p) const { _mm512_storeu_ps(p, v); }
+    };
+
+    struct Vm {
+        __mmask16 m;
+    };
+
+    inline Vf operator+(Vf a, Vf b) { return { _mm512_add_ps(a.v, b.v) }; }
+    inline Vf operator-(Vf a, Vf b) { return { _mm512_sub_ps(a.v, b.v) }; }
+    inline Vf operator*(Vf a, Vf b) { return { _mm512_mul_ps(a.v, b.v) }; }
+    inline Vf operator/(Vf a, Vf b) { return { _mm512_div_ps(a.v, b.v) }; }
+    inline Vm operator<(Vf a, Vf b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Vm operator>(Vf a, Vf b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Vm operator&(Vm a, Vm b) { return { static_cast<__mmask16>(a.m & b.m) }; }
+    inline Vm operator|(Vm a, Vm b) { return { static_cast<__mmask16>(a.m | b.m) }; }
+    inline Vm andNot(Vm a, Vm b) { return { static_cast<__mmask16>(~a.m & b.m) }; }//~a & b
+    inline Vf vsqrt(Vf a) { return { _mm512_sqrt_ps(a.v) }; }
+    inline Vf vabs(Vf a) { return { _mm512_abs_ps(a.v) }; }
+    inline Vf select(Vm m, Vf a, Vf b) { return { _mm512_mask_blend_ps(m.m, b.v, a.v) }; }
+    inline unsigned maskBits(Vm m) { return static_cast<unsigned>(m.m); }
+    inline Vm maskFromBits(unsigned bits) { return { static_cast<__mmask16>(bits) }; }
+}
+
+#include "../headers/packetKernel.hpp"
+
+uint64_t RayPackets::advanceAvx512(RayPacket& packet, const PacketParams& params) {
+    return PacketKernel::advanceLanes<Vf, Vm>(packet, 0, params);
+}
@@ -7,14 +7,18 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "../headers/renderer.hpp"
 #include "../headers/glHelpers.hpp"
+#include "../headers/deflectionLut.hpp"
 #include <glad/glad.h>
 #include <stdexcept>
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <GLFW/glfw3.h>
+#include <cstdio>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
 #include <stb_image.h>
-#include "stb_easy_font.h"
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -45,76 +49,50 @@ static unsigned int compileShader(unsigned int type, const std::string& src) {
     return shader;
 }
 
-//Utility to load a texture from file
-static GLuint loadTexture(const std::string& path) {
-    int width, height, channels;
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 4);
-    if (!data) throw std::runtime_error("Failed to load texture: " + path);
-
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    stbi_image_free(data);
-    return tex;
+//Point k of the 2D Sobol sequence (van der Corput, then the x + 1 polynomial's direction numbers) in [0, 1)^2
+static glm::vec2 sobol2(unsigned int k) {
+    unsigned int x = 0, y = 0;
+    unsigned int vx = 1u << 31, vy = 1u << 31;
+    for (; k != 0; k >>= 1, vx >>= 1, vy ^= vy >> 1) {
+        if (k & 1u) {
+            x ^= vx;
+            y ^= vy;
+        }
+    }
+    return glm::vec2(static_cast<float>(x), static_cast<float>(y)) * (1.0f / 4294967296.0f);
 }
 
 //----------------- Constructor -----------------
-Renderer::Renderer(int width, int height)
-    : m_width(width), m_height(height), m_quadVAO(0), m_quadVBO(0), m_shaderProgram(0)
+Renderer::Renderer(int width, int height, HdrFormat hdrFormat, const std::string& atlasPath)
+    : m_width(width), m_height(height), m_quadVAO(0), m_quadVBO(0), m_hdrFormat(hdrFormat)
 {
 	//Setup up Quad and shaders for screen-space rendering
     initFullscreenQuad();
     initShaders();
 
-    //init compute shader
-    m_computeShader = GLHelpers::loadComputeShader("shaders/geodesic.comp");
+    //init compute shaders, trace and shade
+    m_computeShader = ShaderProgram(GLHelpers::loadComputeShader("shaders/geodesic.comp"));
+    std::string targetFormats = std::string("#define RENDER_FORMAT ") + HdrFormats::info(m_hdrFormat).imageFormat
+        + "\n#define BLOOM_FORMAT " + HdrFormats::info(HdrFormats::bloomFormat(m_hdrFormat)).imageFormat + "\n";
+    m_shadeShader = ShaderProgram(GLHelpers::loadComputeShader("shaders/geodesicShade.comp", targetFormats));
+    m_reprojectShader = ShaderProgram(GLHelpers::loadComputeShader("shaders/reproject.comp"));
+    m_refineShader = ShaderProgram(GLHelpers::loadComputeShader("shaders/refine.comp"));
+    m_supersampleShader = ShaderProgram(GLHelpers::loadComputeShader("shaders/supersample.comp"));
+    initDeflectionLut(atlasPath);
+
+    //The shaders declare their block bindings, these only fix up one that doesn't
+    m_computeShader.bindBlock("CameraBlock", 0);
+    m_computeShader.bindBlock("BlackHoleBlock", 1);
+    m_computeShader.bindBlock("PlanetBlock", 3);
+    m_lutShader.bindBlock("BlackHoleBlock", 1);
+    m_atlasShader.bindBlock("BlackHoleBlock", 1);
 
     //init render texture
     initRenderTexture();
-    initBloomTextures();
-
-    initUBO();
-    initBlackHoleUBO();
+    initGBuffer();
+    m_bloom.init(m_width, m_height, HdrFormats::bloomFormat(m_hdrFormat));
 
-    glGenBuffers(1, &m_planetSSBO);
-
-    glGenBuffers(1, &m_diskUBO);
-    glBindBuffer(GL_UNIFORM_BUFFER, m_diskUBO);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(DiskBlock), nullptr, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 2, m_diskUBO);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-	//Setup planets
-    for (size_t i = 0; i < m_planets.size(); ++i) {
-        const Planet& planet = m_planets[i];
-
-        //Set up UBO for this planet
-        PlanetBlock planetBlock;
-        planetBlock.planetPosition = planet.position;
-        planetBlock.planetRadius = planet.radius;
-        planetBlock.planetColor = planet.color;
-        planetBlock._pad = 0.0f;
-
-        glBindBuffer(GL_UNIFORM_BUFFER, m_planetUBO);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PlanetBlock), &planetBlock);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-        //Bind planet texture to a texture unit (e.g., 7 + i)
-        glActiveTexture(GL_TEXTURE7 + static_cast<GLenum>(i));
-        glBindTexture(GL_TEXTURE_2D, planet.texture);
-        glUniform1i(glGetUniformLocation(m_computeShader, "uPlanetTex"), 7 + static_cast<GLint>(i));
-    }
-
-    //Time UBO (for animation)
-    glGenBuffers(1, &m_timeUBO);
-    glBindBuffer(GL_UNIFORM_BUFFER, m_timeUBO);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(float), nullptr, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 4, m_timeUBO);//binding = 4
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    //Camera, black hole, disk, planet and time blocks, the planets and their hierarchy all go through m_frameData
 
 	//Load smoke texture (for accretion disk)
     int texWidth, texHeight, texChannels;
@@ -208,7 +186,7 @@ Renderer::Renderer(int width, int height)
     earth.radius = 6378.0f * scale;
     earth.color = glm::vec3(1.0f);
     earth.texturePath = "textures/planets/earthTexture.jpg";
-    earth.texture = loadTexture(earth.texturePath);
+    earth.textureLayer = m_planetTextures.layer(earth.texturePath);
     m_planets.push_back(earth);
 
     Planet mars;
@@ -216,8 +194,9 @@ Renderer::Renderer(int width, int height)
     mars.radius = 3389.5f * scale;
     mars.color = glm::vec3(1.0f, 0.5f, 0.3f);
     mars.texturePath = "textures/planets/marsTexture.jpg";
-    mars.texture = loadTexture(mars.texturePath);
+    mars.textureLayer = m_planetTextures.layer(mars.texturePath);
     m_planets.push_back(mars);
+    m_basePlanets = m_planets.size();
 
     //Setup grid
     m_grid = new Grid3D(-50.0f, 50.0f, 1.0f, bhRadiusSim);
@@ -230,29 +209,56 @@ const std::vector<Planet>& Renderer::getPlanets() const {
 
 //----------------- Destructor -----------------
 Renderer::~Renderer() {
-    glDeleteProgram(m_shaderProgram);
     glDeleteVertexArrays(1, &m_quadVAO);
     glDeleteBuffers(1, &m_quadVBO);
-    glDeleteBuffers(1, &m_blackHoleUBO);
+    glDeleteBuffers(1, &m_lutRowsSSBO);
+    glDeleteBuffers(1, &m_lutSamplesSSBO);
+    glDeleteBuffers(1, &m_atlasOrbitsSSBO);
+    glDeleteBuffers(1, &m_atlasSamplesSSBO);
+    glDeleteBuffers(1, &m_gbufferSSBO);
+    glDeleteBuffers(1, &m_prevGbufferSSBO);
+    glDeleteBuffers(1, &m_traceListSSBO);
+    glDeleteBuffers(1, &m_sampleIndexSSBO);
+    glDeleteBuffers(1, &m_sampleGbufferSSBO);
+    glDeleteBuffers(1, &m_sampleListSSBO);
+    glDeleteBuffers(1, &m_cubemapSSBO);
+    glDeleteBuffers(1, &m_rayPoolSSBO);
+    glDeleteBuffers(2, m_rayQueueSSBO);
+    glDeleteBuffers(1, &m_countReadback);
+    if (m_countFence) glDeleteSync(m_countFence);
     delete m_grid;
 }
 
-//----------------- UBOs -----------------
-void Renderer::initUBO() {
-    glGenBuffers(1, &m_cameraUBO);
-    glBindBuffer(GL_UNIFORM_BUFFER, m_cameraUBO);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUBO), nullptr, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, m_cameraUBO);//binding=0
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-}
+//----------------- Deflection Table -----------------
+//Rows and samples written by deflectionLut.comp and read by geodesic.comp (bindings 8 and 9)
+void Renderer::initDeflectionLut(const std::string& atlasPath) {
+    m_lutShader = ShaderProgram(GLHelpers::loadComputeShader("shaders/deflectionLut.comp"));
+
+    glGenBuffers(1, &m_lutRowsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lutRowsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, DeflectionLut::ENTRIES * sizeof(DeflectionLut::Row), nullptr, GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &m_lutSamplesSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lutSamplesSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, DeflectionLut::ENTRIES * DeflectionLut::SAMPLES * sizeof(glm::vec2), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    //Atlas orbits and samples go to the GPU once, straight from the mapping (bindings 10 and 11)
+    if (atlasPath.empty()) return;
+    if (!m_atlas.map(atlasPath)) {
+        std::cout << "No lensing atlas at " << atlasPath << " (run with --build-atlas), integrating the deflection table every frame" << std::endl;
+        return;
+    }
+    m_atlasShader = ShaderProgram(GLHelpers::loadComputeShader("shaders/atlasResample.comp"));
+
+    glGenBuffers(1, &m_atlasOrbitsSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_atlasOrbitsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, LensingAtlas::orbitBytes(), m_atlas.orbits(), GL_STATIC_DRAW);
 
-//----------------- Black Hole UBO -----------------
-void Renderer::initBlackHoleUBO() {
-    glGenBuffers(1, &m_blackHoleUBO);
-    glBindBuffer(GL_UNIFORM_BUFFER, m_blackHoleUBO);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(BlackHoleUBO), nullptr, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 1, m_blackHoleUBO); //binding=1
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glGenBuffers(1, &m_atlasSamplesSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_atlasSamplesSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, LensingAtlas::sampleBytes(), m_atlas.samples(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 //----------------- Fullscreen Quad -----------------
@@ -295,66 +301,21 @@ void Renderer::initShaders() {
     unsigned int vert = compileShader(GL_VERTEX_SHADER, vertSrc);
     unsigned int frag = compileShader(GL_FRAGMENT_SHADER, fragSrc);
 
-    m_shaderProgram = glCreateProgram();
-    glAttachShader(m_shaderProgram, vert);
-    glAttachShader(m_shaderProgram, frag);
-    glLinkProgram(m_shaderProgram);
+    GLuint blitProgram = glCreateProgram();
+    glAttachShader(blitProgram, vert);
+    glAttachShader(blitProgram, frag);
+    glLinkProgram(blitProgram);
 
     int success;
-    glGetProgramiv(m_shaderProgram, GL_LINK_STATUS, &success);
+    glGetProgramiv(blitProgram, GL_LINK_STATUS, &success);
     if (!success) {
         char info[512];
-        glGetProgramInfoLog(m_shaderProgram, 512, nullptr, info);
+        glGetProgramInfoLog(blitProgram, 512, nullptr, info);
         throw std::runtime_error("Shader linking error: " + std::string(info));
     }
+    m_shaderProgram = ShaderProgram(blitProgram);
 
-    //Load and compile debug text shaders
-    std::string textVertSrc = loadFile("shaders/debugtext/text.vert");
-    std::string textFragSrc = loadFile("shaders/debugtext/text.frag");
-    GLuint textVert = compileShader(GL_VERTEX_SHADER, textVertSrc);
-    GLuint textFrag = compileShader(GL_FRAGMENT_SHADER, textFragSrc);
-    m_debugTextShader = glCreateProgram();
-    glAttachShader(m_debugTextShader, textVert);
-    glAttachShader(m_debugTextShader, textFrag);
-    glLinkProgram(m_debugTextShader);
-    glDeleteShader(textVert);
-    glDeleteShader(textFrag);
-
-    //Create VAO/VBO for text
-    glGenVertexArrays(1, &m_debugTextVAO);
-    glGenBuffers(1, &m_debugTextVBO);
-    glBindVertexArray(m_debugTextVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, m_debugTextVBO);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 16, (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
-    //Bloom extract shader
-    std::string extractFrag = loadFile("shaders/bloomExtract.frag");
-    m_bloomExtractShader = glCreateProgram();
-    {
-        unsigned int vert2 = compileShader(GL_VERTEX_SHADER, vertSrc);
-        unsigned int frag2 = compileShader(GL_FRAGMENT_SHADER, extractFrag);
-        glAttachShader(m_bloomExtractShader, vert2);
-        glAttachShader(m_bloomExtractShader, frag2);
-        glLinkProgram(m_bloomExtractShader);
-        glDeleteShader(vert2);
-        glDeleteShader(frag2);
-    }
-
-    //Bloom blur shader
-    std::string blurFrag = loadFile("shaders/bloomBlur.frag");
-    m_bloomBlurShader = glCreateProgram();
-    {
-        unsigned int vert2 = compileShader(GL_VERTEX_SHADER, vertSrc);
-        unsigned int frag2 = compileShader(GL_FRAGMENT_SHADER, blurFrag);
-        glAttachShader(m_bloomBlurShader, vert2);
-        glAttachShader(m_bloomBlurShader, frag2);
-        glLinkProgram(m_bloomBlurShader);
-        glDeleteShader(vert2);
-        glDeleteShader(frag2);
-    }
+    m_debugOverlay.init();
 
     glDeleteShader(vert);
     glDeleteShader(frag);
@@ -363,17 +324,22 @@ void Renderer::initShaders() {
 //----------------- Render -----------------
 //Main render function, called every frame
 void Renderer::render(const Camera& camera, float fps) {
-    //Get current time 
-    float time = static_cast<float>(glfwGetTime());
-    glBindBuffer(GL_UNIFORM_BUFFER, m_timeUBO);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(float), &time);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    //Get current time, held while progressive accumulation runs so the frames it averages show the same scene
+    bool progressive = m_progressive && !m_lensingCubemap;
+    if (!progressive) m_time = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_startTime).count();
+    float time = m_time;
+
+    //Every block uploaded this frame, the five uniform blocks plus the planets and their hierarchy
+    //(fewer than 2 nodes per planet)
+    size_t planetCount = m_planets.size();
+    size_t frameBytes = sizeof(float) + sizeof(CameraUBO) + sizeof(DiskBlock) + sizeof(PlanetBlock) + sizeof(BlackHoleUBO)
+        + planetCount * (sizeof(PlanetDataGPU) + sizeof(int32_t)) + (2 * planetCount + 1) * sizeof(BodyBvh::Node);
+    m_frameData.beginFrame(frameBytes, 8);
+    m_frameData.bind(GL_UNIFORM_BUFFER, 4, &time, sizeof(float));
 
     //Update Camera UBO
     CameraUBO data = camera.getUBO();
-    glBindBuffer(GL_UNIFORM_BUFFER, m_cameraUBO);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraUBO), &data);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_frameData.bind(GL_UNIFORM_BUFFER, 0, &data, sizeof(CameraUBO));
 
 	//Set up accretion disk parameters
     DiskBlock diskBlock;
@@ -382,9 +348,7 @@ void Renderer::render(const Camera& camera, float fps) {
     diskBlock.diskColor = glm::vec3(1.0f, 0.7f, 0.2f);
     diskBlock._pad = 0.0f;
 
-    glBindBuffer(GL_UNIFORM_BUFFER, m_diskUBO);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(DiskBlock), &diskBlock);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_frameData.bind(GL_UNIFORM_BUFFER, 2, &diskBlock, sizeof(DiskBlock));
 
 	//Update planet positions based on time
 	//For demo purposes, we fake circular orbits
@@ -410,174 +374,302 @@ void Renderer::render(const Camera& camera, float fps) {
     planetBlock.planetRadius = 2.0f;
     planetBlock.planetColor = glm::vec3(0.2f, 0.5f, 1.0f);
     planetBlock._pad = 0.0f;
+    m_frameData.bind(GL_UNIFORM_BUFFER, 3, &planetBlock, sizeof(PlanetBlock));
 
-    glBindBuffer(GL_UNIFORM_BUFFER, m_planetUBO);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PlanetBlock), &planetBlock);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GLState::bindTexture(5, GL_TEXTURE_2D, m_smokeTex);
+    m_shadeShader.set("uSmokeTex", 5);
 
-    glActiveTexture(GL_TEXTURE5);//Use texture unit 5
-    glBindTexture(GL_TEXTURE_2D, m_smokeTex);
-    glUniform1i(glGetUniformLocation(m_computeShader, "uSmokeTex"), 5);
-
-    glActiveTexture(GL_TEXTURE6); //Use texture unit 6
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_skyboxTex);
-    glUniform1i(glGetUniformLocation(m_computeShader, "uSkybox"), 6);
+    GLState::bindTexture(6, GL_TEXTURE_CUBE_MAP, m_skyboxTex);
+    m_shadeShader.set("uSkybox", 6);
 
     glDisable(GL_DEPTH_TEST);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	//Prepare debug text lines
-	//We use stb_easy_font for simplicity
-	//Not optimal for large amounts of text and good performance
-	//But good enough for basic debug info and current project scale
-    std::vector<std::string> debugLines;
-    glm::vec3 camPos = camera.getPosition();
-
-	std::string tab = "    ";
-
-    debugLines.push_back("Camera Info");
-    debugLines.push_back(tab + "Camera Position: (" + std::to_string(camPos.x) + ", " + std::to_string(camPos.y) + ", " + std::to_string(camPos.z) + ")");
-    debugLines.push_back(tab + "FPS: " + std::to_string(fps));
-    debugLines.push_back("\n");
-
-    debugLines.push_back("BlackHole Info");
-    debugLines.push_back(tab + "Black Hole Radius: " + std::to_string(bhRadiusSim));
-    debugLines.push_back(tab + "Black Hole Mass: " + std::to_string(m_bhMass) + " kg");
-    debugLines.push_back("\n");
-
-    debugLines.push_back("Simulation Info");
-    debugLines.push_back(tab + "Simulation Scale Factor:" + std::to_string(scale));
-    debugLines.push_back("\n");
-
-    debugLines.push_back("Planet Info");
-    if (!m_planets.empty()) {
-        const glm::vec3& earthPos = m_planets[0].position;
-        debugLines.push_back(tab + "Earth Position: (" + std::to_string(earthPos.x) + ", " + std::to_string(earthPos.y) + ", " + std::to_string(earthPos.z) + ")");
-
-        const glm::vec3& marsPos = m_planets[1].position;
-        debugLines.push_back(tab + "Mars Position: (" + std::to_string(marsPos.x) + ", " + std::to_string(marsPos.y) + ", " + std::to_string(marsPos.z) + ")");
-
-		//For demo purposes, calculate and display number of Earth orbits completed
-        //double omega_earth = m_planets[0].orbitSpeed;
-        //if (omega_earth > 0.0) {
-        //    double T = 2.0 * M_PI / omega_earth;
-        //    double orbitCount = simTime / T;
-        //    debugLines.push_back(tab + "Earth Orbits: " + std::to_string(orbitCount));
-        //}
+    if (m_showDebugText) {
+        updateDebugText(camera, fps, progressive);
     }
 
     //Prepare planet data for SSBO
-    struct PlanetDataGPU {
-        glm::vec3 position;
-        float radius;
-        glm::vec3 color;
-        float _pad;
-    };
     std::vector<PlanetDataGPU> planetData;
-    for (const auto& p : m_planets) {
+    m_planetTree.spheres.clear();
+    for (const Planet& p : m_planets) {
         PlanetDataGPU pd;
         pd.position = p.position;
         pd.radius = p.radius;
         pd.color = p.color;
-        pd._pad = 0.0f;
+        pd.texture = p.textureLayer;
         planetData.push_back(pd);
+        m_planetTree.spheres.push_back(glm::vec4(p.position, p.radius));
     }
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_planetSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, planetData.size() * sizeof(PlanetDataGPU), planetData.data(), GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_planetSSBO);
+    m_frameData.bind(GL_SHADER_STORAGE_BUFFER, 7, planetData.data(), planetData.size() * sizeof(PlanetDataGPU));
+
+    //The planets moved, so their hierarchy is rebuilt (a few thousand bodies take well under a millisecond)
+    BodyBvh::build(m_planetTree);
+    m_frameData.bind(GL_SHADER_STORAGE_BUFFER, 20, m_planetTree.nodes.data(), m_planetTree.nodes.size() * sizeof(BodyBvh::Node));
+    m_frameData.bind(GL_SHADER_STORAGE_BUFFER, 21, m_planetTree.indices.data(), m_planetTree.indices.size() * sizeof(int32_t));
 
     //Set uNumPlanets uniform
-    glUseProgram(m_computeShader);
-    glUniform1i(glGetUniformLocation(m_computeShader, "uNumPlanets"), static_cast<GLint>(m_planets.size()));
+    m_computeShader.set("uNumPlanets", static_cast<GLint>(m_planets.size()));
+    m_computeShader.set("uIntegrator", static_cast<GLint>(m_integrator));
+    m_computeShader.set("uTolerance", m_tolerance);
+    m_computeShader.set("uAnalyticEscape", m_analyticEscape ? 1 : 0);
+    m_computeShader.set("uClassifyRays", m_classifyRays ? 1 : 0);
 
-    //Bind planet textures to units 10, 11, ...
-    for (size_t i = 0; i < m_planets.size(); ++i) {
-        glActiveTexture(GL_TEXTURE10 + static_cast<GLenum>(i));
-        glBindTexture(GL_TEXTURE_2D, m_planets[i].texture);
-    }
+    //Planet textures, one array for all of them on unit 10. Only layers added since the last frame are uploaded
+    m_planetTextures.upload();
+    GLState::bindTexture(10, GL_TEXTURE_2D_ARRAY, m_planetTextures.texture());
 
     //--- Compute Shader Pass ---
-    glUseProgram(m_computeShader);
-    GLuint blockIndex = glGetUniformBlockIndex(m_computeShader, "CameraBlock");
-    if (blockIndex != GL_INVALID_INDEX) {
-        glUniformBlockBinding(m_computeShader, blockIndex, 0);
-    }
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, m_cameraUBO);
-
-    glBindBuffer(GL_UNIFORM_BUFFER, m_planetUBO);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PlanetBlock), &planetBlock);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
     //Update Black Hole UBO
     BlackHoleUBO bhData;
     bhData.bhPosition = glm::vec3(0.0f, 0.0f, 0.0f);
     bhData.bhRadius = bhRadiusSim;
+    m_frameData.bind(GL_UNIFORM_BUFFER, 1, &bhData, sizeof(BlackHoleUBO));
+
+    //--- Deflection Table Pass ---
+    //One orbit per angle from the camera-to-hole direction, geodesic.comp rotates them into each pixel's plane
+    float lutMaxAngle = 0.0f;
+    if (m_deflectionLut) {
+        CameraUBO cameraData = camera.getUBO();
+        glm::vec3 cameraPos = glm::vec3(cameraData.position);
+        //The cubemap looks every way from the camera
+        lutMaxAngle = m_lensingCubemap ? static_cast<float>(M_PI)
+            : DeflectionLut::maxAngle(cameraData.invView, cameraData.invProj, cameraPos, bhData.bhPosition);
+
+        //Resampled from the atlas when it covers the camera, integrated otherwise
+        float camRadius = glm::length(cameraPos - bhData.bhPosition);
+        m_atlasInUse = m_atlas.mapped() && camRadius >= LensingAtlas::MIN_CAMERA_RADIUS * bhData.bhRadius
+            && camRadius <= LensingAtlas::C_MAX * bhData.bhRadius;
+        ShaderProgram& tableShader = m_atlasInUse ? m_atlasShader : m_lutShader;
+
+        //The table only depends on these, a camera that hasn't moved or turned keeps last frame's
+        glm::vec4 lutInputs(camRadius, lutMaxAngle, bhData.bhRadius, static_cast<float>(m_integrator) + (m_atlasInUse ? 0.5f : 0.0f));
+        if (lutInputs != m_lutInputs) {
+            m_lutInputs = lutInputs;
+            tableShader.use();
+            tableShader.set("uCamRadius", camRadius);
+            tableShader.set("uMaxAngle", lutMaxAngle);
+            tableShader.set("uIntegrator", static_cast<GLint>(m_integrator));
+            GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, m_lutRowsSSBO);
+            GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, m_lutSamplesSSBO);
+            if (m_atlasInUse) {
+                GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, m_atlasOrbitsSSBO);
+                GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, m_atlasSamplesSSBO);
+            }
+            glDispatchCompute((DeflectionLut::ENTRIES + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+    }
+    m_computeShader.set("uDeflectionLut", m_deflectionLut ? 1 : 0);
+    m_computeShader.set("uLutMaxAngle", lutMaxAngle);
 
-    glBindBuffer(GL_UNIFORM_BUFFER, m_blackHoleUBO);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(BlackHoleUBO), &bhData);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GLuint groupsX = (m_width + 7) / 8;
+    GLuint groupsY = (m_height + 7) / 8;
 
-    GLuint bhBlockIndex = glGetUniformBlockIndex(m_computeShader, "BlackHoleBlock");
-    if (bhBlockIndex != GL_INVALID_INDEX) {
-        glUniformBlockBinding(m_computeShader, bhBlockIndex, 1);
+    //--- Trace Pass ---
+    //Everything geodesic.comp reads besides the camera (the table's range and source follow from it),
+    //time and textures only enter the shade pass
+    std::vector<float> traceInputs = {
+        m_lensingCubemap ? 1.0f : 0.0f,
+        bhData.bhPosition.x, bhData.bhPosition.y, bhData.bhPosition.z, bhData.bhRadius,
+        diskBlock.diskInnerRadius, diskBlock.diskOuterRadius,
+        static_cast<float>(m_integrator), m_tolerance, m_analyticEscape ? 1.0f : 0.0f, m_classifyRays ? 1.0f : 0.0f,
+        m_deflectionLut ? 1.0f : 0.0f, m_variableRate ? 1.0f : 0.0f,
+        m_adaptiveSamples ? 1.0f : 0.0f, progressive ? 1.0f : 0.0f };
+    for (const auto& p : planetData) {
+        traceInputs.insert(traceInputs.end(), { p.position.x, p.position.y, p.position.z, p.radius });
     }
-    glBindBufferBase(GL_UNIFORM_BUFFER, 1, m_blackHoleUBO);
-
-    GLuint planetBlockIndex = glGetUniformBlockIndex(m_computeShader, "PlanetBlock");
-    if (planetBlockIndex != GL_INVALID_INDEX) {
-        glUniformBlockBinding(m_computeShader, planetBlockIndex, 3);
+    //The cubemap only depends on where the camera is, not where it looks
+    CameraUBO traceCamera = camera.getUBO();
+    bool cameraMoved = traceCamera.position != m_tracedCamera.position
+        || (!m_lensingCubemap && (traceCamera.view != m_tracedCamera.view || traceCamera.proj != m_tracedCamera.proj));
+    bool sceneChanged = traceInputs != m_traceInputs;
+    m_traced = sceneChanged || cameraMoved;
+
+    readListCounts();
+    if (m_lensingCubemap && m_cubemapSSBO == 0) {
+        glGenBuffers(1, &m_cubemapSSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_cubemapSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(6) * CUBEMAP_SIZE * CUBEMAP_SIZE * GBUFFER_TEXEL_BYTES, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
     }
-    glBindBufferBase(GL_UNIFORM_BUFFER, 3, m_planetUBO);
 
-    glBindImageTexture(0, m_renderTex, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    //Only the camera moved: reproject last frame's G-buffer and trace what it can't cover
+    bool reproject = m_traced && !sceneChanged && m_temporalReprojection && !m_lensingCubemap;
+    if (reproject) {
+        std::swap(m_gbufferSSBO, m_prevGbufferSSBO);
+    }
+    GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, m_lensingCubemap ? m_cubemapSSBO : m_gbufferSSBO);
+
+    if (m_traced) {
+        CameraUBO prevCamera = m_tracedCamera;
+        m_traceInputs = traceInputs;
+        m_tracedCamera = traceCamera;
+        m_computeShader.set("uCubemap", m_lensingCubemap ? 1 : 0);
+        m_computeShader.set("uTraceList", reproject ? 1 : 0);
+        m_computeShader.set("uCoarseStep", 1);
+        m_computeShader.set("uSampleList", 0);
+        m_computeShader.set("uJitter", glm::vec2(0.5f, 0.5f));
+        if (m_lensingCubemap) {
+            m_computeShader.set("uImageSize", glm::ivec2(CUBEMAP_SIZE, CUBEMAP_SIZE));
+            dispatchTrace((CUBEMAP_SIZE + 7) / 8, (CUBEMAP_SIZE + 7) / 8, 6);
+            m_tracedPixels = 6 * CUBEMAP_SIZE * CUBEMAP_SIZE;
+            m_traceCountPending = false;
+        }
+        else if (reproject) {
+            clearTraceList(m_traceListSSBO);
+            GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, m_prevGbufferSSBO);
+
+            glm::mat4 prevViewProj = prevCamera.proj * prevCamera.view;
+            m_reprojectShader.use();
+            m_reprojectShader.set("uPrevViewProj", prevViewProj);
+            m_reprojectShader.set("uPrevInvView", prevCamera.invView);
+            m_reprojectShader.set("uPrevInvProj", prevCamera.invProj);
+            m_reprojectShader.set("uPrevCamPos", glm::vec3(prevCamera.position));
+            m_reprojectShader.set("uImageSize", glm::ivec2(m_width, m_height));
+            m_reprojectShader.set("uFrame", m_reprojectFrame++);
+            glDispatchCompute(groupsX, groupsY, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+            m_computeShader.set("uImageSize", glm::ivec2(m_width, m_height));
+            dispatchTrace(0, 0, 0, m_traceListSSBO);
+            m_tracedBeforeList = 0;
+            copyListCount(m_traceListSSBO, 0);
+        }
+        else if (m_variableRate) {
+            //Coarse grid first, refine.comp then fills in the cells whose corners agree and lists the rest
+            GLuint gridX = (m_width + VARIABLE_RATE_STEP - 2) / VARIABLE_RATE_STEP + 1;
+            GLuint gridY = (m_height + VARIABLE_RATE_STEP - 2) / VARIABLE_RATE_STEP + 1;
+            clearTraceList(m_traceListSSBO);
+            m_computeShader.set("uImageSize", glm::ivec2(m_width, m_height));
+            m_computeShader.set("uCoarseStep", VARIABLE_RATE_STEP);
+            dispatchTrace((gridX + 7) / 8, (gridY + 7) / 8, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            GLuint cellsX = (m_width + VARIABLE_RATE_STEP - 1) / VARIABLE_RATE_STEP;
+            GLuint cellsY = (m_height + VARIABLE_RATE_STEP - 1) / VARIABLE_RATE_STEP;
+            m_refineShader.use();
+            m_refineShader.set("uImageSize", glm::ivec2(m_width, m_height));
+            glDispatchCompute((cellsX + 7) / 8, (cellsY + 7) / 8, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+            m_computeShader.set("uCoarseStep", 1);
+            m_computeShader.set("uTraceList", 1);
+            dispatchTrace(0, 0, 0, m_traceListSSBO);
+            m_tracedBeforeList = gridX * gridY;
+            copyListCount(m_traceListSSBO, 0);
+        }
+        else {
+            m_computeShader.set("uImageSize", glm::ivec2(m_width, m_height));
+            dispatchTrace(groupsX, groupsY, 1);
+            m_tracedPixels = m_width * m_height;
+            m_traceCountPending = false;
+        }
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
 
-    GLuint groupsX = (m_width + 7) / 8;
-    GLuint groupsY = (m_height + 7) / 8;
-    glDispatchCompute(groupsX, groupsY, 1);
+    //--- Accumulation Trace Pass ---
+    //A still scene traces the whole screen again at the next subpixel offset, the shade pass averages it in.
+    //Sobol point 1 is the pixel centre the first frame used
+    if (m_traced || !progressive) {
+        m_accumFrames = 0;
+    }
+    bool jitter = progressive && m_accumFrames > 0 && m_accumFrames < ACCUMULATION_FRAMES;
+    if (jitter) {
+        glm::vec2 offset = sobol2(static_cast<unsigned int>(m_accumFrames) + 1);
+        m_computeShader.set("uJitter", glm::vec2(offset.x, offset.y));
+        m_computeShader.set("uCubemap", 0);
+        m_computeShader.set("uTraceList", 0);
+        m_computeShader.set("uCoarseStep", 1);
+        m_computeShader.set("uSampleList", 0);
+        m_computeShader.set("uImageSize", glm::ivec2(m_width, m_height));
+        dispatchTrace(groupsX, groupsY, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        m_tracedPixels = m_width * m_height;
+        m_traceCountPending = false;
+    }
 
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    //--- Supersample Pass ---
+    //Extra rays where one per pixel undersamples, listed by supersample.comp once the G-buffer is complete.
+    //Reprojected frames drop the samples instead of re-tracing them all every frame of a move, the first
+    //frame the camera holds still catches up. Accumulation frames sample the pixel by jittering instead
+    bool supersample = m_adaptiveSamples && !m_lensingCubemap && !jitter;
+    if (!supersample || reproject) {
+        m_samplesValid = false;
+        m_extraSamples = 0;
+        m_sampleCountPending = false;
+    }
+    else if (m_traced || !m_samplesValid) {
+        clearTraceList(m_sampleListSSBO);
+        GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, m_sampleListSSBO);
+        m_supersampleShader.use();
+        m_supersampleShader.set("uImageSize", glm::ivec2(m_width, m_height));
+        m_supersampleShader.set("uSampleBudget", m_sampleBudget);
+        glDispatchCompute(groupsX, groupsY, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        m_computeShader.set("uImageSize", glm::ivec2(m_width, m_height));
+        m_computeShader.set("uCoarseStep", 1);
+        m_computeShader.set("uTraceList", 1);
+        m_computeShader.set("uSampleList", 1);
+        GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, m_sampleGbufferSSBO);
+        dispatchTrace(0, 0, 0, m_sampleListSSBO);
+        GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, m_gbufferSSBO);
+        GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, m_traceListSSBO);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        copyListCount(m_sampleListSSBO, 1);
+        m_samplesValid = true;
+    }
+    //Copies made this frame, none go out while a fence is still pending
+    if (!m_countFence && (m_traceCountPending || m_sampleCountPending)) {
+        m_countFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
 
-    //--- Bloom Extract Pass ---
-    glUseProgram(m_bloomExtractShader);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_bloomExtractFBO);
-    glViewport(0, 0, m_width, m_height);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_renderTex);
-    glUniform1i(glGetUniformLocation(m_bloomExtractShader, "uRenderTex"), 0);
-    glUniform1f(glGetUniformLocation(m_bloomExtractShader, "uThreshold"), 0.1f);
-    glBindVertexArray(m_quadVAO);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    //--- Shade Pass ---
+    //Blends into the running mean with weight 1 / frames, the first frame overwrites it. A finished
+    //accumulation keeps m_renderTex as it is, it is only shaded again (with weight 0) for bloom's level 0
+    //when bloom is turned on after it finished
+    bool bloom = m_bloomStrength > 0.0f;
+    bool accumulating = m_accumFrames < ACCUMULATION_FRAMES;
+    if (accumulating || (bloom && !m_bloomCurrent)) {
+        m_shadeShader.use();
+        m_shadeShader.set("uCubemap", m_lensingCubemap ? 1 : 0);
+        m_shadeShader.set("uCubeSize", CUBEMAP_SIZE);
+        m_shadeShader.set("uSupersample", m_samplesValid ? 1 : 0);
+        m_shadeShader.set("uBlend", accumulating ? 1.0f / static_cast<float>(m_accumFrames + 1) : 0.0f);
+        m_shadeShader.set("uBloom", bloom ? 1 : 0);
+        m_shadeShader.set("uBloomThreshold", BLOOM_THRESHOLD);
+        GLState::bindImageTexture(0, m_renderTex, 0, GL_READ_WRITE, HdrFormats::info(m_hdrFormat).internalFormat);
+        GLState::bindImageTexture(1, m_bloom.texture(), 0, GL_WRITE_ONLY, HdrFormats::info(HdrFormats::bloomFormat(m_hdrFormat)).internalFormat);
+        glDispatchCompute(groupsX, groupsY, 1);
+        if (accumulating) ++m_accumFrames;
+        m_bloomCurrent = false;
+
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+    }
 
-    //--- Bloom Blur Passes (ping-pong) ---
-    bool horizontal = true, first_iteration = true;
-    int blurPasses = 8;
-    for (int i = 0; i < blurPasses; ++i) {
-        glUseProgram(m_bloomBlurShader);
-        glBindFramebuffer(GL_FRAMEBUFFER, m_bloomBlurFBO[horizontal]);
-        glViewport(0, 0, m_width, m_height);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, first_iteration ? m_bloomExtractTex : m_bloomBlurTex[!horizontal]);
-        glUniform1i(glGetUniformLocation(m_bloomBlurShader, "uImage"), 0);
-        glUniform2f(glGetUniformLocation(m_bloomBlurShader, "uDirection"), horizontal ? 1.0f : 0.0f, horizontal ? 0.0f : 1.0f);
-        glBindVertexArray(m_quadVAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        horizontal = !horizontal;
-        if (first_iteration) first_iteration = false;
+    //--- Bloom Passes ---
+    //Down and back up the half-float chain from the level 0 the shade pass left. Nothing runs while bloom is
+    //off, nor while the image holds still and level 0 already has its bloom
+    if (bloom && !m_bloomCurrent) {
+        m_bloom.render(m_quadVAO);
+        m_bloomCurrent = true;
     }
 
     //--- Final Composite Pass ---
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    //Level 0 holds the sum of every level's blur, divided back down to one
+    GLState::bindFramebuffer(m_outputFramebuffer);
     glViewport(0, 0, m_width, m_height);
-    glUseProgram(m_shaderProgram);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_renderTex);
-    glUniform1i(glGetUniformLocation(m_shaderProgram, "uRenderTex"), 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, m_bloomBlurTex[!horizontal]);
-    glUniform1i(glGetUniformLocation(m_shaderProgram, "uBloomTex"), 1);
-    glUniform1f(glGetUniformLocation(m_shaderProgram, "uBloomStrength"), 0.0f);
-    glBindVertexArray(m_quadVAO);
+    m_shaderProgram.use();
+    GLState::bindTexture(0, GL_TEXTURE_2D, m_renderTex);
+    m_shaderProgram.set("uRenderTex", 0);
+    if (bloom) {
+        GLState::bindTexture(1, GL_TEXTURE_2D, m_bloom.texture());
+    }
+    m_shaderProgram.set("uBloomTex", 1);
+    m_shaderProgram.set("uBloomStrength", bloom ? m_bloomStrength / static_cast<float>(m_bloom.levels()) : 0.0f);
+    GLState::bindVertexArray(m_quadVAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
     //Draw the 3D grid only if draw grid is true
@@ -586,86 +678,314 @@ void Renderer::render(const Camera& camera, float fps) {
     }
 
     if (m_showDebugText) {
-        renderDebugText(debugLines);
+        m_debugOverlay.draw(m_width, m_height);
+    }
+    m_frameData.endFrame();
+    GLState::endFrame();
+}
+
+//----------------- Integrator -----------------
+void Renderer::toggleIntegrator() {
+    m_integrator = static_cast<IntegratorType>((static_cast<int>(m_integrator) + 1) % 3);
+}
+
+void Renderer::scaleTolerance(float factor) {
+    m_tolerance = glm::clamp(m_tolerance * factor, 1e-8f, 1e-2f);
+}
+
+void Renderer::setDebrisBelt(int bodies) {
+    m_beltBodies = std::max(bodies, 0);
+    m_planets.resize(m_basePlanets);
+    if (m_beltBodies == 0) return;
+
+    //Kepler's third law, the inner edge at 12 rs goes round once a minute like the demo year
+    const double timeScale = 31557600.0 / 60.0;
+    double innerSpeed = 2.0 * 3.14159265358979 / (60.0 * timeScale);
+    for (const BeltBody& body : Physics::debrisBelt(m_beltBodies, bhRadiusSim)) {
+        Planet planet;
+        planet.position = body.position(body.orbitPhase);
+        planet.radius = body.radius;
+        planet.color = body.color;
+        planet.orbitRadius = body.orbitRadius;
+        planet.orbitSpeed = innerSpeed * std::pow(12.0 * bhRadiusSim / body.orbitRadius, 1.5);
+        planet.orbitPhase = body.orbitPhase;
+        planet.orbitInclination = body.orbitInclination;
+        m_planets.push_back(planet);
     }
 }
 
 void Renderer::initRenderTexture() {
     glGenTextures(1, &m_renderTex);
     glBindTexture(GL_TEXTURE_2D, m_renderTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_width, m_height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, HdrFormats::info(m_hdrFormat).internalFormat, m_width, m_height, 0, GL_RGBA, GL_FLOAT, nullptr);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void Renderer::initBloomTextures() {
-    //Extract texture
-    glGenTextures(1, &m_bloomExtractTex);
-    glBindTexture(GL_TEXTURE_2D, m_bloomExtractTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_width, m_height, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+//----------------- HDR Targets -----------------
+size_t Renderer::hdrTargetBytes(HdrFormat format, int width, int height) {
+    return static_cast<size_t>(width) * height * HdrFormats::info(format).bytesPerPixel
+        + Bloom::chainBytes(width, height, HdrFormats::info(HdrFormats::bloomFormat(format)).bytesPerPixel);
+}
 
-    //Blur textures (ping-pong)
-    glGenTextures(2, m_bloomBlurTex);
-    for (int i = 0; i < 2; ++i) {
-        glBindTexture(GL_TEXTURE_2D, m_bloomBlurTex[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_width, m_height, 0, GL_RGBA, GL_FLOAT, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+//The shade pass writes the image and the composite reads it, a frame of progressive accumulation also reads
+//it back for the blend (one more image's worth, not counted)
+size_t Renderer::hdrFrameTraffic(HdrFormat format, int width, int height, bool bloom) {
+    size_t traffic = 2 * static_cast<size_t>(width) * height * HdrFormats::info(format).bytesPerPixel;
+    if (bloom) {
+        traffic += Bloom::frameTraffic(width, height, HdrFormats::info(HdrFormats::bloomFormat(format)).bytesPerPixel);
     }
+    return traffic;
+}
 
-    //FBOs
-    glGenFramebuffers(1, &m_bloomExtractFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, m_bloomExtractFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_bloomExtractTex, 0);
+//Every format's footprint at this size, to pick one for large stills on small GPUs
+void Renderer::reportHdrTargets(int width, int height, HdrFormat inUse) {
+    std::cout << "HDR targets at " << width << "x" << height << " (--hdr-format):" << std::endl;
+    for (int i = 0; i < HdrFormats::COUNT; ++i) {
+        HdrFormat format = static_cast<HdrFormat>(i);
+        char line[160];
+        std::snprintf(line, sizeof(line), "  %-11s %2d B/pixel  %7.1f MB  %7.1f MB/frame, %7.1f MB/frame with bloom%s",
+            HdrFormats::info(format).name, HdrFormats::info(format).bytesPerPixel,
+            hdrTargetBytes(format, width, height) / (1024.0 * 1024.0),
+            hdrFrameTraffic(format, width, height, false) / (1024.0 * 1024.0),
+            hdrFrameTraffic(format, width, height, true) / (1024.0 * 1024.0),
+            format == inUse ? "  <- in use" : "");
+        std::cout << line << std::endl;
+    }
+}
 
-    glGenFramebuffers(2, m_bloomBlurFBO);
-    for (int i = 0; i < 2; ++i) {
-        glBindFramebuffer(GL_FRAMEBUFFER, m_bloomBlurFBO[i]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_bloomBlurTex[i], 0);
+//Written by geodesic.comp, read by geodesicShade.comp (binding 12), the previous one by reproject.comp
+void Renderer::initGBuffer() {
+    GLuint gbuffers[2];
+    glGenBuffers(2, gbuffers);
+    for (GLuint gbuffer : gbuffers) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, gbuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_width) * m_height * GBUFFER_TEXEL_BYTES, nullptr, GL_DYNAMIC_COPY);
+    }
+    m_gbufferSSBO = gbuffers[0];
+    m_prevGbufferSSBO = gbuffers[1];
+
+    //Indirect dispatch size and count, then one pixel index per listed pixel
+    glGenBuffers(1, &m_traceListSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_traceListSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint) + static_cast<GLsizeiptr>(m_width) * m_height * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, m_traceListSSBO);
+
+    //Adaptive supersampling: slot index per pixel, the slots' texels and the list of rays to trace into them
+    m_sampleBudget = static_cast<GLuint>(m_width) * m_height / 2;
+    glGenBuffers(1, &m_sampleIndexSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sampleIndexSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_width) * m_height * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glGenBuffers(1, &m_sampleGbufferSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sampleGbufferSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_sampleBudget) * GBUFFER_TEXEL_BYTES, nullptr, GL_DYNAMIC_COPY);
+    glGenBuffers(1, &m_sampleListSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sampleListSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint) + static_cast<GLsizeiptr>(m_sampleBudget) * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, m_sampleIndexSSBO);
+    GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, m_sampleGbufferSSBO);
+
+    //Wavefront mode: the saved state of the rays between chunks, and the two queues of pool slots
+    m_rayPoolSize = static_cast<GLuint>(m_width) * m_height / RAY_POOL_SHARE;
+    glGenBuffers(1, &m_rayPoolSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_rayPoolSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_rayPoolSize) * RAY_STATE_BYTES, nullptr, GL_DYNAMIC_COPY);
+    glGenBuffers(2, m_rayQueueSSBO);
+    for (GLuint queue : m_rayQueueSSBO) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, queue);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint) + static_cast<GLsizeiptr>(m_rayPoolSize) * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, m_rayPoolSSBO);
+
+    //Trace and sample list counts for the overlay
+    glGenBuffers(1, &m_countReadback);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_countReadback);
+    glBufferData(GL_COPY_WRITE_BUFFER, 2 * sizeof(GLuint), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 }
 
-//Render debug text using stb_easy_font
-void Renderer::renderDebugText(const std::vector<std::string>& lines) {
-    float x = 10.0f, y = 30.0f;
-    char buffer[99999];
-    std::vector<float> vertices;
-
-    for (const auto& line : lines) {
-        int quads = stb_easy_font_print(x, y, (char*)line.c_str(), NULL, buffer, sizeof(buffer));
-        float* buf = (float*)buffer;
-        for (int i = 0; i < quads * 4; ++i) {
-            vertices.push_back(buf[i * 4 + 0]);
-            vertices.push_back(buf[i * 4 + 1]);
-        }
-        y += 20.0f;
+//Empty list for reproject.comp, refine.comp, supersample.comp or a wavefront chunk to fill. The shaders raise the
+//group count with atomicMax, an empty list dispatches no workgroups. Cleared on the GPU, nothing is uploaded
+void Renderer::clearTraceList(GLuint list) {
+    const GLuint emptyList[4] = { 0, 1, 1, 0 };//Groups x, y, z, then the count
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, list);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_RGBA32UI, 0, sizeof(emptyList), GL_RGBA_INTEGER, GL_UNSIGNED_INT, emptyList);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+//Queue a GPU copy of a list's count into readback slot 0 (trace list) or 1 (sample list), only while the overlay
+//is shown and the last copies have been read
+void Renderer::copyListCount(GLuint list, int slot) {
+    if (!m_showDebugText || m_countFence) return;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, list);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_countReadback);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 3 * sizeof(GLuint), slot * sizeof(GLuint), sizeof(GLuint));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (slot == 0) {
+        m_traceCountPending = true;
+        m_pendingBeforeList = m_tracedBeforeList;
     }
+    else {
+        m_sampleCountPending = true;
+    }
+}
 
-    if (vertices.empty()) return;
+//Take the copied counts once the GPU is past them, a fence still pending leaves last values in place
+void Renderer::readListCounts() {
+    if (!m_countFence) return;
+    GLenum state = glClientWaitSync(m_countFence, 0, 0);
+    if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) return;
+    glDeleteSync(m_countFence);
+    m_countFence = nullptr;
+
+    GLuint counts[2] = { 0, 0 };
+    glBindBuffer(GL_COPY_READ_BUFFER, m_countReadback);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counts), counts);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    if (m_traceCountPending) m_tracedPixels = counts[0] + m_pendingBeforeList;
+    if (m_sampleCountPending) m_extraSamples = counts[1];
+    m_traceCountPending = false;
+    m_sampleCountPending = false;
+}
 
-    glm::mat4 ortho = glm::ortho(0.0f, float(m_width), float(m_height), 0.0f);
+//geodesic.comp over a groupsX x groupsY x groupsZ grid, or indirectly over indirectList. In wavefront mode that
+//dispatch marches the first chunk, then each further chunk runs over the rays the one before queued. The chunks
+//are dispatched blind, an empty queue dispatches no workgroups. A grid larger than the screen overflows the pool
+//(RAY_POOL_SHARE) and is marched in one dispatch, the lists never hold more than the screen's pixels. Binds
+//geodesic.comp itself, its uniforms are set without it
+void Renderer::dispatchTrace(GLuint groupsX, GLuint groupsY, GLuint groupsZ, GLuint indirectList) {
+    size_t screenGroups = static_cast<size_t>((m_width + 7) / 8) * ((m_height + 7) / 8);
+    bool wavefront = m_wavefront && (indirectList != 0 || static_cast<size_t>(groupsX) * groupsY * groupsZ <= screenGroups);
+    m_computeShader.use();
+    m_computeShader.set("uWavefront", wavefront ? 1 : 0);
+    if (wavefront) {
+        m_computeShader.set("uChunkSteps", WAVEFRONT_CHUNK);
+        m_computeShader.set("uRayPoolSize", m_rayPoolSize);
+        clearTraceList(m_rayQueueSSBO[1]);
+        GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, m_rayQueueSSBO[1]);
+    }
 
-    glUseProgram(m_debugTextShader);
-    glUniformMatrix4fv(glGetUniformLocation(m_debugTextShader, "uOrtho"), 1, GL_FALSE, &ortho[0][0]);
-    glUniform3f(glGetUniformLocation(m_debugTextShader, "uColor"), 1.0f, 1.0f, 0.0f);
+    if (indirectList != 0) {
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, indirectList);
+        glDispatchComputeIndirect(0);
+    }
+    else {
+        glDispatchCompute(groupsX, groupsY, groupsZ);
+    }
 
-    glBindVertexArray(m_debugTextVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, m_debugTextVBO);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    if (wavefront) {
+        m_computeShader.set("uWavefront", 2);
+        for (int step = WAVEFRONT_CHUNK; step < MARCH_STEPS; step += WAVEFRONT_CHUNK) {
+            std::swap(m_rayQueueSSBO[0], m_rayQueueSSBO[1]);
+            //The queue the last dispatch filled, and the one it read to be cleared
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+            clearTraceList(m_rayQueueSSBO[1]);
+            GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, m_rayQueueSSBO[0]);
+            GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, m_rayQueueSSBO[1]);
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_rayQueueSSBO[0]);
+            glDispatchComputeIndirect(0);
+        }
+    }
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+//----------------- Debug Text -----------------
+//Lines for the overlay, only built while it is shown. Lines whose text is the same as last frame's cost the
+//string formatting and nothing else
+void Renderer::updateDebugText(const Camera& camera, float fps, bool progressive) {
+    m_debugLines.clear();
+    glm::vec3 camPos = camera.getPosition();
 
-    //Draw each quad as a triangle fan
-    for (size_t i = 0; i < vertices.size() / 2; i += 4) {
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 8, &vertices[i * 2], GL_DYNAMIC_DRAW);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	std::string tab = "    ";
+
+    m_debugLines.push_back("Camera Info");
+    m_debugLines.push_back(tab + "Camera Position: (" + std::to_string(camPos.x) + ", " + std::to_string(camPos.y) + ", " + std::to_string(camPos.z) + ")");
+    m_debugLines.push_back(tab + "FPS: " + std::to_string(fps));
+    m_debugLines.push_back("\n");
+
+    m_debugLines.push_back("BlackHole Info");
+    m_debugLines.push_back(tab + "Black Hole Radius: " + std::to_string(bhRadiusSim));
+    m_debugLines.push_back(tab + "Black Hole Mass: " + std::to_string(m_bhMass) + " kg");
+    m_debugLines.push_back("\n");
+
+    m_debugLines.push_back("Simulation Info");
+    m_debugLines.push_back(tab + "Simulation Scale Factor:" + std::to_string(scale));
+    if (m_integrator == IntegratorType::DormandPrince) {
+        char tolerance[32];
+        std::snprintf(tolerance, sizeof(tolerance), "%.0e", m_tolerance);
+        m_debugLines.push_back(tab + "Integrator: Dormand-Prince 5(4), tolerance " + tolerance + " (I, [ ])");
+    }
+    else if (m_integrator == IntegratorType::Binet) {
+        m_debugLines.push_back(tab + "Integrator: Binet, orbital plane (I)");
     }
+    else {
+        m_debugLines.push_back(tab + "Integrator: RK4, fixed step (I)");
+    }
+    m_debugLines.push_back(tab + std::string("Analytic Escape: ") + (m_analyticEscape ? "On" : "Off") + " (X)");
+    m_debugLines.push_back(tab + std::string("Impact Classification: ") + (m_classifyRays ? "On" : "Off") + " (C)");
+    m_debugLines.push_back(tab + std::string("Deflection Table: ") + (m_deflectionLut ? (m_atlasInUse ? "Atlas" : "Integrated") : "Off") + " (L)");
+    m_debugLines.push_back(tab + std::string("Geodesic Trace: ") + (m_traced ? "Traced" : "Cached, shading only"));
+    m_debugLines.push_back(tab + std::string("Temporal Reprojection: ") + (m_temporalReprojection ? "On" : "Off") + " (T), last trace "
+        + std::to_string(m_tracedPixels * 100 / std::max(m_width * m_height, 1)) + "% of pixels");
+    m_debugLines.push_back(tab + std::string("Wavefront: ") + (m_wavefront ? "On, " + std::to_string(WAVEFRONT_CHUNK) + " step chunks" : std::string("Off")) + " (K)");
+    m_debugLines.push_back(tab + std::string("Variable Rate: ") + (m_variableRate ? "On" : "Off") + " (R)");
+    char samples[64];
+    std::snprintf(samples, sizeof(samples), "%u extra rays last pass (%.2f per pixel)", m_extraSamples,
+        static_cast<double>(m_extraSamples) / std::max(m_width * m_height, 1));
+    m_debugLines.push_back(tab + std::string("Adaptive Supersampling: ") + (m_adaptiveSamples ? "On" : "Off") + " (M), " + samples);
+    if (progressive) {
+        m_debugLines.push_back(tab + "Progressive Accumulation: On (P), " + std::to_string(m_accumFrames) + "/"
+            + std::to_string(ACCUMULATION_FRAMES) + " frames, animation paused");
+    }
+    else {
+        m_debugLines.push_back(tab + std::string("Progressive Accumulation: ") + (m_progressive ? "Off in cubemap mode" : "Off") + " (P)");
+    }
+    m_debugLines.push_back(tab + std::string("Lensing Cubemap: ") + (m_lensingCubemap ? "On" : "Off") + " (V)");
+    char hdrTargets[96];
+    std::snprintf(hdrTargets, sizeof(hdrTargets), "%s, %.1f MB, %.1f MB/frame of target traffic", HdrFormats::info(m_hdrFormat).name,
+        hdrTargetBytes(m_hdrFormat, m_width, m_height) / (1024.0 * 1024.0),
+        hdrFrameTraffic(m_hdrFormat, m_width, m_height, m_bloomStrength > 0.0f) / (1024.0 * 1024.0));
+    m_debugLines.push_back(tab + "HDR Targets: " + hdrTargets);
+    m_debugLines.push_back(tab + std::string("Bloom: ") + (m_bloomStrength > 0.0f ? "On, " + std::to_string(m_bloom.levels()) + " half-float levels from half resolution" : std::string("Off, skipped")) + " (N)");
+    const FrameRing::Stats& frameData = m_frameData.lastFrame();
+    m_debugLines.push_back(tab + "Frame Data: " + std::to_string(frameData.blocks) + " blocks, " + std::to_string(frameData.bytes / 1024)
+        + " KB last frame through the mapped ring (" + std::to_string(FrameRing::FRAMES) + " x " + std::to_string(m_frameData.regionBytes() / 1024)
+        + " KB), " + std::to_string(frameData.fenceWaits) + " fence waits, " + std::to_string(frameData.reallocations) + " reallocations");
+    const GLState::Stats& glCalls = GLState::lastFrame();
+    m_debugLines.push_back(tab + "GL State: " + std::to_string(glCalls.issued) + " binds and uniform writes last frame, "
+        + std::to_string(glCalls.skipped) + " redundant ones skipped, " + std::to_string(glCalls.programSwitches) + " program switches");
+    m_debugLines.push_back("\n");
+
+    m_debugLines.push_back("Planet Info");
+    if (!m_planets.empty()) {
+        const glm::vec3& earthPos = m_planets[0].position;
+        m_debugLines.push_back(tab + "Earth Position: (" + std::to_string(earthPos.x) + ", " + std::to_string(earthPos.y) + ", " + std::to_string(earthPos.z) + ")");
+
+        const glm::vec3& marsPos = m_planets[1].position;
+        m_debugLines.push_back(tab + "Mars Position: (" + std::to_string(marsPos.x) + ", " + std::to_string(marsPos.y) + ", " + std::to_string(marsPos.z) + ")");
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
-}
\ No newline at end of file
+		//For demo purposes, calculate and display number of Earth orbits completed
+        //double omega_earth = m_planets[0].orbitSpeed;
+        //if (omega_earth > 0.0) {
+        //    double T = 2.0 * M_PI / omega_earth;
+        //    double orbitCount = simTime / T;
+        //    m_debugLines.push_back(tab + "Earth Orbits: " + std::to_string(orbitCount));
+        //}
+    }
+    m_debugLines.push_back(tab + std::string("Debris Belt: ") + (m_beltBodies > 0 ? "On, " + std::to_string(m_beltBodies) + " bodies" : std::string("Off"))
+        + " (B), hierarchy " + std::to_string(m_planetTree.nodes.size()) + " nodes");
+    m_debugLines.push_back(tab + "Planet Textures: " + std::to_string(m_planetTextures.layerCount()) + " layers of "
+        + std::to_string(PlanetTextureArray::LAYER_WIDTH) + "x" + std::to_string(PlanetTextureArray::LAYER_HEIGHT) + ", one bind");
+    const DebugOverlay::Stats& overlay = m_debugOverlay.lastFrame();
+    m_debugLines.push_back(tab + "Debug Overlay: " + std::to_string(overlay.lines) + " lines, " + std::to_string(overlay.rebuiltLines)
+        + " rebuilt and " + std::to_string(overlay.uploadedBytes) + " bytes uploaded last frame, " + std::to_string(overlay.quads) + " quads in one draw (H)");
+
+    m_debugOverlay.setLines(m_debugLines);
+}
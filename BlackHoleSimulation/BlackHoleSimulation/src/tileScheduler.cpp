@@ -0,0 +1,129 @@
+/*
+	Work-stealing tile scheduler used by the CPU tracer.
+*/
+
+#include "../headers/tileScheduler.hpp"
+
+//----------------- Constructor -----------------
+TileScheduler::TileScheduler(unsigned threadCount)
+    : m_threadCount(threadCount)
+{
+    if (m_threadCount == 0) {
+        m_threadCount = std::thread::hardware_concurrency();
+    }
+    if (m_threadCount == 0) {
+        m_threadCount = 1;
+    }
+
+    for (unsigned i = 0; i < m_threadCount; ++i) {
+        m_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+
+	//Worker 0 is the thread calling run(), spawn the rest
+    for (unsigned i = 1; i < m_threadCount; ++i) {
+        m_threads.emplace_back(&TileScheduler::workerLoop, this, i);
+    }
+}
+
+//----------------- Destructor -----------------
+TileScheduler::~TileScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (auto& t : m_threads) {
+        t.join();
+    }
+}
+
+//----------------- Run -----------------
+void TileScheduler::run(int tilesX, int tilesY, const TileFn& fn) {
+    int total = tilesX * tilesY;
+    if (total <= 0) return;
+
+	//Give each worker a contiguous block of tiles so neighbouring rays stay on one core
+    for (unsigned w = 0; w < m_threadCount; ++w) {
+        int begin = static_cast<int>(static_cast<long long>(total) * w / m_threadCount);
+        int end = static_cast<int>(static_cast<long long>(total) * (w + 1) / m_threadCount);
+        std::lock_guard<std::mutex> lock(m_queues[w]->mutex);
+        for (int t = begin; t < end; ++t) {
+            m_queues[w]->tiles.push_back(t);
+        }
+    }
+
+	//Publish the job and wake the workers
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_fn = &fn;
+        m_tilesX = tilesX;
+        m_remaining = total;
+        m_busyWorkers = m_threadCount - 1;
+        ++m_generation;
+    }
+    m_wake.notify_all();
+
+    drain(0);
+
+	//Every queue is empty once all workers have left drain()
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+    m_fn = nullptr;
+}
+
+//----------------- Worker -----------------
+void TileScheduler::workerLoop(unsigned worker) {
+    unsigned long long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_quit || m_generation != seen; });
+            if (m_quit) return;
+            seen = m_generation;
+        }
+
+        drain(worker);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_busyWorkers == 0) {
+            m_done.notify_one();
+        }
+    }
+}
+
+//Process tiles until neither the local queue nor any victim has work left
+void TileScheduler::drain(unsigned worker) {
+    int tile;
+    while (m_remaining.load(std::memory_order_relaxed) > 0) {
+        if (!popLocal(worker, tile) && !steal(worker, tile)) {
+            break;
+        }
+        (*m_fn)(tile % m_tilesX, tile / m_tilesX, worker);
+        m_remaining.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+//Own work comes off the front, keeping scanline order within a block
+bool TileScheduler::popLocal(unsigned worker, int& tile) {
+    WorkerQueue& q = *m_queues[worker];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tiles.empty()) return false;
+    tile = q.tiles.front();
+    q.tiles.pop_front();
+    return true;
+}
+
+//Stolen work comes off the back, furthest from where the owner is working
+bool TileScheduler::steal(unsigned worker, int& tile) {
+    for (unsigned i = 1; i < m_threadCount; ++i) {
+        WorkerQueue& q = *m_queues[(worker + i) % m_threadCount];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tiles.empty()) {
+            tile = q.tiles.back();
+            q.tiles.pop_back();
+            m_steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}